@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+# Общие функции для бенчмарков: сборка тестовых программ и замер времени.
+
+ROOT=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-$ROOT/_bench_build}
+REPEATS=${REPEATS:-3}
+
+# Программы и входные данные, на которых проводятся замеры
+PROGRAMS=(fibbonachi exp2 factorial-pure square)
+declare -A INPUTS=([fibbonachi]=30 [exp2]=21 [factorial-pure]=9 [square]=1500)
+
+mkdir -p "$BUILD_DIR"
+
+# build <программа> <имя бинарника> [флаги gcc...]
+# Тесты закомментированы целиком (в проекте собирается только один main), поэтому снимаем /* */
+build() {
+  local program=$1 name=$2
+  shift 2
+  local source="$BUILD_DIR/$program.c"
+  sed -e '1{/^\/\*$/d}' -e '${/^\*\/$/d}' \
+      -e "s#\"\.\./stella/runtime.h\"#\"$ROOT/stella/runtime.h\"#" \
+      "$ROOT/tests/$program.c" > "$source"
+  gcc -std=c11 -O2 "$@" "$source" "$ROOT/stella/runtime.c" "$ROOT/stella/gc.c" -o "$BUILD_DIR/$name"
+}
+
+# measure <бинарник> <вход> - лучшее из REPEATS время работы в секундах
+measure() {
+  local binary=$1 input=$2 best="" t
+  local TIMEFORMAT=%R
+  for ((i = 0; i < REPEATS; i++)); do
+    t=$( { time echo "$input" | "$BUILD_DIR/$binary" > /dev/null; } 2>&1 )
+    if [[ -z $best ]] || awk "BEGIN { exit !($t < $best) }"; then best=$t; fi
+  done
+  echo "$best"
+}
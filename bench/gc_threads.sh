@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+# Масштабирование параллельной копирующей сборки старшего поколения по числу потоков (STELLA_GC_THREADS).
+# Для каждого числа потоков печатаются время работы, суммарная и наибольшая пауза старшего поколения,
+# ускорение его сборок относительно первого числа потоков в списке и кол-во украденных объектов
+# (по экспорту статистики STELLA_GC_STATS_FILE).
+# Использование: bench/gc_threads.sh (переменные окружения THREADS="1 2 4 8", REPEATS, STELLA_GC_* учитываются)
+set -e
+. "$(dirname "$0")/common.sh"
+
+STATS="$BUILD_DIR/gc_threads.json"
+THREADS=${THREADS:-1 2 4 8}
+
+# stat <ключ> - значение счетчика из последнего экспорта
+stat() {
+  grep -o "\"$1\": [0-9.]*" "$STATS" | cut -d' ' -f2
+}
+
+echo "cores: $(nproc)"
+printf "%-16s %-8s %8s %10s %12s %12s %10s %12s\n" \
+  PROGRAM INPUT THREADS TIME OLD_MS MAX_US SPEEDUP STEALS
+for program in "${PROGRAMS[@]}"; do
+  build "$program" "$program-default"
+  input=${INPUTS[$program]}
+  base=""
+
+  for threads in $THREADS; do
+    export STELLA_GC_THREADS=$threads STELLA_GC_OLD_COLLECTOR=copying
+    time=$(measure "$program-default" "$input")
+    echo "$input" | STELLA_GC_STATS_FILE="$STATS" "$BUILD_DIR/$program-default" > /dev/null
+
+    old=g$(( $(stat generations) - 1 ))
+    total=$(stat ${old}_pause_total_ns)
+    base=${base:-$total}
+    printf "%-16s %-8s %8d %10s %12.1f %12.1f %10.2f %12d\n" "$program" "$input" "$threads" "$time" \
+      "$(awk "BEGIN { print $total / 1e6 }")" \
+      "$(awk "BEGIN { print $(stat ${old}_pause_max_ns) / 1e3 }")" \
+      "$(awk "BEGIN { print $total == 0 ? 0 : $base / $total }")" \
+      "$(stat parallel_steals)"
+  done
+done
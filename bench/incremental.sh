@@ -0,0 +1,97 @@
+#!/usr/bin/env bash
+# Паузы инкрементальной сборки старшего поколения (STELLA_GC_INCREMENTAL_QUANTUM) против сборки с остановкой мира.
+# Для каждого кванта печатаются время работы, медиана, 99-й перцентиль и наибольшая из всех пауз и суммарное время
+# сборки, а затем распределение пауз по степеням двойки наносекунд (по экспорту статистики STELLA_GC_STATS_FILE).
+# Каждый квант прогоняется еще и с адаптивным поколением 0 (режим <квант>@<цель паузы в мкс>): его размер
+# меняется посреди цикла инкрементальной сборки.
+# Использование: bench/incremental.sh (переменные окружения QUANTA="4K 16K 64K", PAUSE_TARGETS="1000", REPEATS,
+# STELLA_GC_* учитываются)
+set -e
+. "$(dirname "$0")/common.sh"
+
+STATS="$BUILD_DIR/incremental.json"
+QUANTA=${QUANTA:-4K 16K 64K}
+PAUSE_TARGETS=${PAUSE_TARGETS:-1000}
+MIN_EXPONENT=10
+MAX_EXPONENT=30
+
+# stat <ключ> - значение счетчика из последнего экспорта
+stat() {
+  grep -o "\"$1\": [0-9.]*" "$STATS" | cut -d' ' -f2
+}
+
+# stw - сборка с остановкой мира (квант 0)
+MODES="stw $QUANTA"
+for target in $PAUSE_TARGETS; do
+  for quantum in $QUANTA; do
+    MODES+=" $quantum@$target"
+  done
+done
+declare -A HISTOGRAMS
+
+printf "%-16s %-8s %8s %10s %10s %10s %12s %10s %8s\n" \
+  PROGRAM INPUT QUANTUM TIME P50_US P99_US MAX_US GC_MS CYCLES
+for program in "${PROGRAMS[@]}"; do
+  build "$program" "$program-default"
+  input=${INPUTS[$program]}
+
+  for mode in $MODES; do
+    export STELLA_GC_OLD_COLLECTOR=copying
+    quantum=${mode%@*}
+    if [[ $quantum == stw ]]; then
+      export STELLA_GC_INCREMENTAL_QUANTUM=0
+    else
+      export STELLA_GC_INCREMENTAL_QUANTUM=$quantum
+    fi
+    if [[ $mode == *@* ]]; then
+      export STELLA_GC_PAUSE_TARGET=${mode#*@}
+    fi
+    time=$(measure "$program-default" "$input")
+    echo "$input" | STELLA_GC_STATS_FILE="$STATS" "$BUILD_DIR/$program-default" > /dev/null
+    if [[ $mode == *@* ]]; then
+      unset STELLA_GC_PAUSE_TARGET
+    fi
+
+    printf "%-16s %-8s %8s %10s %10.1f %10.1f %12.1f %10.3f %8d\n" "$program" "$input" "$mode" "$time" \
+      "$(awk "BEGIN { print $(stat pause_p50_ns) / 1e3 }")" \
+      "$(awk "BEGIN { print $(stat pause_p99_ns) / 1e3 }")" \
+      "$(awk "BEGIN { print $(stat pause_max_ns) / 1e3 }")" \
+      "$(awk "BEGIN { print $(stat gc_time_ns) / 1e6 }")" \
+      "$(stat incremental_cycles)"
+
+    row=""
+    for ((e = MIN_EXPONENT; e <= MAX_EXPONENT; e++)); do
+      row+=" $(stat pause_log2_ns_$e)"
+    done
+    HISTOGRAMS["$program $mode"]=$row
+  done
+done
+
+# Кол-во пауз в корзинах [2^e, 2^(e+1)) нс: крайние корзины вбирают все паузы короче и длиннее,
+# пустые с обоих концов диапазона не печатаются
+echo
+first=$MAX_EXPONENT
+last=$MIN_EXPONENT
+for row in "${HISTOGRAMS[@]}"; do
+  e=$MIN_EXPONENT
+  for pauses in $row; do
+    if ((pauses > 0 && e < first)); then first=$e; fi
+    if ((pauses > 0 && e > last)); then last=$e; fi
+    e=$((e + 1))
+  done
+done
+
+printf "%-16s %8s" PROGRAM QUANTUM
+for ((e = first; e <= last; e++)); do printf " %7s" "2^$e"; done
+printf "\n"
+for program in "${PROGRAMS[@]}"; do
+  for mode in $MODES; do
+    printf "%-16s %8s" "$program" "$mode"
+    e=$MIN_EXPONENT
+    for pauses in ${HISTOGRAMS["$program $mode"]}; do
+      if ((e >= first && e <= last)); then printf " %7d" "$pauses"; fi
+      e=$((e + 1))
+    done
+    printf "\n"
+  done
+done
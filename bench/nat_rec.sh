@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+# Сколько промежуточных замыканий создают каррированные функции шага Nat::rec
+# (их не создает stella_object_nat_rec2, принимающая функцию шага от двух аргументов).
+# Программы собираются с STELLA_RUNTIME_STATS, замыкания считаются по выделениям TAG_FN во время вызова f(i).
+# Затем fibbonachi сравнивается с fibbonachi-rec2 (та же программа с функцией шага от двух аргументов и
+# stella_object_nat_rec2): сколько замыканий и байт выделено на самом деле и время работы.
+# Использование: bench/nat_rec.sh (переменные окружения STELLA_GC_* учитываются)
+set -e
+. "$(dirname "$0")/common.sh"
+
+# runtime_stats <программа> <вход> - вывод статистики среды выполнения в одну строку:
+# итерации Nat::rec, замыкания шага, все выделенные замыкания, их байты, всего выделенных байт
+runtime_stats() {
+  echo "$2" | "$BUILD_DIR/$1-runtime-stats" | awk '
+    $1 == "FN" { closures = $2; closure_bytes = $3 }
+    $1 ~ /^[A-Z]+$/ && NF == 6 && $2 ~ /^[0-9]+$/ { bytes += $3 }
+    /^Nat::rec iterations:/ {
+      gsub(/,/, "")
+      iterations = $3; step_closures = $7
+    }
+    END { print iterations + 0, step_closures + 0, closures + 0, closure_bytes + 0, bytes + 0 }'
+}
+
+printf "%-16s %-8s %12s %12s %14s %14s\n" PROGRAM INPUT ITERATIONS CLOSURES PER_ITERATION BYTES_AVOIDED
+for program in fibbonachi factorial-pure square; do
+  build "$program" "$program-runtime-stats" -DSTELLA_RUNTIME_STATS
+
+  input=${INPUTS[$program]}
+  read -r iterations step_closures closures closure_bytes bytes <<< "$(runtime_stats "$program" "$input")"
+  printf "%-16s %-8s %12d %12d %14.2f %14d\n" "$program" "$input" "$iterations" "$step_closures" \
+    "$(awk "BEGIN { print $iterations == 0 ? 0 : $step_closures / $iterations }")" \
+    "$(( closures == 0 ? 0 : step_closures * closure_bytes / closures ))"
+done
+
+echo
+printf "%-16s %-8s %12s %14s %16s %10s\n" PROGRAM INPUT CLOSURES CLOSURE_BYTES ALLOCATED_BYTES TIME
+input=${INPUTS[fibbonachi]}
+for program in fibbonachi fibbonachi-rec2; do
+  build "$program" "$program-runtime-stats" -DSTELLA_RUNTIME_STATS
+  build "$program" "$program-default"
+
+  read -r iterations step_closures closures closure_bytes bytes <<< "$(runtime_stats "$program" "$input")"
+  printf "%-16s %-8s %12d %14d %16d %10s\n" "$program" "$input" "$closures" "$closure_bytes" "$bytes" \
+    "$(measure "$program-default" "$input")"
+  if [[ -z $base_closures ]]; then
+    base_closures=$closures base_bytes=$bytes
+  else
+    echo "rec2 drop: $(( base_closures - closures )) closures, $(( base_bytes - bytes )) bytes"
+  fi
+done
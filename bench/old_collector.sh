@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Сборщик старшего поколения: копирование между полупространствами против сжатия на месте и mark-sweep.
+# Для каждого режима печатаются время работы, пиковый RSS, p99 и наибольшая пауза старшего поколения
+# и суммарное время сборок (по экспорту статистики STELLA_GC_STATS_FILE).
+# Использование: bench/old_collector.sh (переменные окружения REPEATS, STELLA_GC_* учитываются)
+set -e
+. "$(dirname "$0")/common.sh"
+
+STATS="$BUILD_DIR/old_collector.json"
+
+# stat <ключ> - значение счетчика из последнего экспорта
+stat() {
+  grep -o "\"$1\": [0-9.]*" "$STATS" | cut -d' ' -f2
+}
+
+printf "%-16s %-8s %-8s %10s %12s %12s %12s %12s\n" \
+  PROGRAM INPUT MODE TIME RSS_KB P99_US MAX_US GC_MS
+for program in "${PROGRAMS[@]}"; do
+  build "$program" "$program-default"
+  input=${INPUTS[$program]}
+
+  for mode in copying compact sweep; do
+    export STELLA_GC_OLD_COLLECTOR=$mode
+    time=$(measure "$program-default" "$input")
+    echo "$input" | STELLA_GC_STATS_FILE="$STATS" "$BUILD_DIR/$program-default" > /dev/null
+
+    old=g$(( $(stat generations) - 1 ))
+    printf "%-16s %-8s %-8s %10s %12d %12.1f %12.1f %12.1f\n" "$program" "$input" "$mode" "$time" \
+      $(( $(stat peak_rss_bytes) / 1024 )) \
+      "$(awk "BEGIN { print $(stat ${old}_pause_p99_ns) / 1e3 }")" \
+      "$(awk "BEGIN { print $(stat ${old}_pause_max_ns) / 1e3 }")" \
+      "$(awk "BEGIN { print $(stat gc_time_ns) / 1e6 }")"
+  done
+done
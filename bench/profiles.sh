@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+# Накладные расходы профилей сборки GC на тестовых программах:
+#   default             - барьеры считают чтения и записи
+#   STELLA_GC_STATS     - то же и печать статистики при завершении
+#   STELLA_GC_NO_STATS  - без барьера на чтение, барьер на запись - встроенная пометка карты
+#   DEBUG_LOGS          - печать состояния кучи на каждом шаге сборки; время не замеряется (вывод огромный),
+#                         только проверяется, что на маленьком входе ответ совпадает с профилем по умолчанию
+# Использование: bench/profiles.sh (переменные окружения REPEATS, STELLA_GC_* учитываются)
+set -e
+. "$(dirname "$0")/common.sh"
+
+# Маленькие входы для DEBUG_LOGS: сборок на них все равно много, а печать кучи остается обозримой
+declare -A DEBUG_INPUTS=([fibbonachi]=10 [exp2]=5 [factorial-pure]=4 [square]=10)
+
+printf "%-16s %-8s %12s %12s %12s %12s\n" PROGRAM INPUT default STATS NO_STATS DEBUG_LOGS
+for program in "${PROGRAMS[@]}"; do
+  build "$program" "$program-default"
+  build "$program" "$program-stats" -DSTELLA_GC_STATS
+  build "$program" "$program-no-stats" -DSTELLA_GC_NO_STATS
+  build "$program" "$program-debug-logs" -DDEBUG_LOGS
+
+  # ответ программы - последняя строка вывода
+  debug_input=${DEBUG_INPUTS[$program]}
+  expected=$(echo "$debug_input" | "$BUILD_DIR/$program-default" | tail -n 1)
+  actual=$(echo "$debug_input" | "$BUILD_DIR/$program-debug-logs" 2>&1 | tail -n 1)
+  debug_logs=ok
+  if [[ $actual != "$expected" ]]; then debug_logs=FAIL; fi
+
+  input=${INPUTS[$program]}
+  printf "%-16s %-8s %12s %12s %12s %12s\n" "$program" "$input" \
+    "$(measure "$program-default" "$input")" \
+    "$(measure "$program-stats" "$input")" \
+    "$(measure "$program-no-stats" "$input")" \
+    "$debug_logs"
+done
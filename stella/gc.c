@@ -1,86 +1,400 @@
+#define _POSIX_C_SOURCE 199309L
+#define _DEFAULT_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "runtime.h"
 #include "gc.h"
 
 /** Total allocated number of bytes (over the entire duration of the program). */
-int total_allocated_bytes = 0;
-int total_requested_bytes = 0;
+uint64_t total_allocated_bytes = 0;
+uint64_t total_requested_bytes = 0;
 
 /** Total allocated number of objects (over the entire duration of the program). */
-int total_allocated_objects = 0;
+uint64_t total_allocated_objects = 0;
+
+/** Maximum residency: live data measured right after each collection. */
+uint64_t max_residency_bytes = 0;
+uint64_t max_residency_objects = 0;
+
+/** Состояние быстрого пути выделения памяти (см. gc_alloc в gc.h) */
+char *gc_nursery_next = NULL;
+char *gc_nursery_limit = NULL;
+size_t gc_nursery_objects = 0;
+/** Границы поколений для встроенного барьера на запись (см. gc_remember в gc.h) */
+char *gc_nursery_start = NULL;
+char *gc_young_start = NULL;
+char *gc_young_end = NULL;
+char *gc_middle_start = NULL;
+char *gc_middle_end = NULL;
+char *gc_old_start = NULL;
+char *gc_old_end = NULL;
+uint8_t *gc_old_cards = NULL;
+uint32_t *gc_old_dirty = NULL;
+size_t gc_old_dirty_count = 0;
+/** Граница в поколении 0, до которой выделенная память уже учтена в статистике */
+void *nursery_counted = NULL;
+/** Идет ли сборка мусора */
+bool collecting = false;
+
+uint64_t total_reads = 0;
+uint64_t total_writes = 0;
 
-int max_allocated_bytes = 0;
-int max_allocated_objects = 0;
+/** Total count gc collect (over the entire duration of the program). */
+uint64_t total_gc_collect = 0;
 
-int total_reads = 0;
-int total_writes = 0;
+/** Сколько байт страниц мертвых полупространств возвращено ОС (см. gc_release_policy) */
+uint64_t total_released_bytes = 0;
 
-/** Total count gc collect (over the entire duration of the program). */
-int total_gc_collect = 0;
+/** Суммарное время всех пауз на сборку мусора и момент инициализации кучи (нс, монотонные часы) */
+uint64_t total_gc_time_ns = 0;
+uint64_t gc_start_time_ns = 0;
 
 
 #define MAX_ALLOC_SIZE (24 * 64)
+#define GENERATION_COUNT 2
+#define MAX_GENERATIONS 8
 #define GEN_SIZE_MULTIPLIER 4
+#define MAX_OLD_SIZE ((size_t) 1 << 30)
+#define GROWTH_FACTOR 2.0
+#define MIN_NURSERY_SIZE 256
+#define SURVIVOR_RATIO 4
+#define TENURE_AGE 2
+#define SWEEP_QUANTUM (16 * 1024)
+#define MAX_GC_THREADS 64
+#define PLAB_SIZE (4 * 1024)
+#define PARALLEL_MIN_SIZE (256 * 1024)
+#define INCREMENTAL_PACE 2
 //#define DEBUG_LOGS
 
-#define MAX_GC_ROOTS 1024
-int gc_roots_max_size = 0;
-int gc_roots_top = 0;
-void **gc_roots[MAX_GC_ROOTS];
+/** Текущие настройки размеров кучи (заполняются в gc_init) */
+gc_config config;
+
+/** Кол-во записей в одном куске стека корней */
+#define ROOT_CHUNK_SIZE 256
+/** Максимальная глубина стека корней в записях (защита от бесконечной рекурсии) */
+#define MAX_GC_ROOTS (1 << 24)
 
-#define MAX_CHANGED_NODES 1024
-int changed_nodes_top = 0;
-void *changed_nodes[MAX_CHANGED_NODES];
+/** Запись стека корней: count подряд идущих корней, начиная с slots (один корень - кадр из одной ячейки) */
+struct root_frame {
+  void **slots;
+  int count;
+};
+
+/** Кусок стека корней. Куски связаны в список и выделяются по мере роста стека */
+struct root_chunk {
+  struct root_chunk* prev; /** Предыдущий (более глубокий) кусок */
+  struct root_chunk* next; /** Освободившийся следующий кусок, оставленный в запасе */
+  int base; /** Кол-во записей во всех предыдущих кусках */
+  struct root_frame frames[ROOT_CHUNK_SIZE];
+};
 
-/** Обертка на каждый stella-объект. Содержит кастомный заголовок */
+uint64_t gc_roots_max_size = 0;
+/** Текущее кол-во корней (ячеек) во всех записях */
+uint64_t gc_roots_size = 0;
+/** Верхний кусок стека корней */
+struct root_chunk *gc_roots = NULL;
+/** Кол-во записей в верхнем куске */
+int gc_roots_top = ROOT_CHUNK_SIZE;
+
+/** Размер карты (card) в remembered set - 2^CARD_SHIFT байт */
+#define CARD_SHIFT GC_CARD_SHIFT
+#define CARD_SIZE (1 << CARD_SHIFT)
+/** Значение card_start для карты, в которой не начинается ни один объект */
+#define NO_OBJECT_START UINT16_MAX
+
+/** Обертка на каждый stella-объект. Отдельного заголовка сборщика нет:
+ * перенесенный объект помечается битом FORWARDED в object_header, а новый адрес записывается в его первое поле
+ */
 struct gc_object {
-  void* moved_to; /** Указатель на место, куда в процессе forward был перемещен объект */
   stella_object stella_object; /** Запрошенный объект */
 };
 
+/** Бит заголовка stella-объекта: объект перенесен в процессе forward (поля с тегом и кол-вом полей сохраняются) */
+#define FORWARDED (1 << 9)
+/** Биты заголовка stella-объекта с возрастом - числом пережитых малых сборок (у объектов поколения 0) */
+#define AGE_SHIFT 10
+#define MAX_AGE 15
+#define AGE_MASK (MAX_AGE << AGE_SHIFT)
+/** Бит заголовка stella-объекта: объект старшего поколения помечен живым при сжатии (GC_OLD_COMPACT) */
+#define MARKED (1 << 14)
+/** Бит заголовка свободной ячейки неперемещающего старшего поколения (GC_OLD_SWEEP)
+ * или мертвой ячейки, закрывающей остаток буфера переноса параллельной сборки.
+ * Ячейка выглядит как упакованное число (STELLA_NAT_BOXED) с нужным кол-вом полей, поэтому ее можно пройти по размеру,
+ * а указателей в ней нет; первое поле хранит следующую ячейку списка */
+#define FREE_CELL (1 << 15)
+/** Бит заголовка stella-объекта: объект копирует один из потоков параллельной сборки, нового адреса еще нет */
+#define COPYING (1 << 16)
+/** Сколько раз простаивающий поток параллельной сборки уступает ядро, прежде чем засыпать, и на сколько наносекунд */
+#define IDLE_SPINS 64
+#define IDLE_SLEEP_NS 20000
+
+/** Размеры ячеек неперемещающего старшего поколения: от объекта с одним полем до объекта с 15 полями */
+#define MIN_CELL_SIZE (sizeof(stella_object) + sizeof(stella_ref))
+#define MAX_CELL_SIZE (sizeof(stella_object) + 15 * sizeof(stella_ref))
+/** Кол-во списков свободных ячеек: список с номером i хранит ячейки размером i слов (stella_ref) */
+#define CELL_CLASSES (MAX_CELL_SIZE / sizeof(stella_ref) + 1)
+
+/** Свободные ячейки и состояние ленивого подметания неперемещающего старшего поколения */
+struct free_lists {
+  struct gc_object* cells[CELL_CLASSES]; /** Списки свободных ячеек по размеру в словах */
+  size_t free_bytes; /** Объем ячеек в списках */
+  uint8_t* marks; /** Битовая карта пометки: бит на каждое слово места */
+  void* sweep; /** Начало еще не подметенной части места */
+  void* sweep_end; /** Конец подметаемой части (next на момент пометки, дальше объекты выделены после нее) */
+  size_t used; /** Объем живых на момент пометки и выделенных после нее объектов */
+  uint64_t reused_bytes; /** Всего выделено из свободных ячеек (остальное - сдвигом next) */
+};
+
 /** Структура содержащая всю информацию о одной части памяти (from/to) */
 struct space {
   int gen; /** Маркер принадлежности к поколению */
-  int size; /** Размер выделенного куска памяти */
+  size_t size; /** Размер выделенного куска памяти */
   void* next; /** Указатель на первый свободный байт */
   void* heap; /** Указатель на начало выделенного куска памяти */
-} g0_space_from, g1_space_from, g1_space_to;
+  size_t objects; /** Кол-во объектов, выделенных в месте не быстрым путем (после сборки - все объекты места) */
+
+  uint8_t* cards; /** Таблица карт: ненулевая карта содержит объект с указателем в младшее поколение */
+  uint16_t* card_start; /** Смещение первого объекта, начинающегося в карте (NO_OBJECT_START, если такого нет) */
+  uint32_t* dirty; /** Номера помеченных карт (каждая карта попадает в список один раз) */
+  size_t dirty_count; /** Кол-во помеченных карт */
+
+  struct free_lists* free_lists; /** Свободные ячейки (только у неперемещающего старшего поколения, иначе NULL) */
+};
+
+/** Фазы сборки, время которых измеряется отдельно */
+enum gc_phase {
+  PHASE_ROOTS, /** Перенос объектов, достижимых из корней */
+  PHASE_CARDS, /** Перенос объектов, достижимых из помеченных карт старших поколений */
+  PHASE_SCAN, /** Сканирование перенесенных объектов (scan/next) */
+  PHASE_FLIP, /** Смена полупространств и очистка освободившейся памяти */
+  PHASE_MARK, /** Пометка живых объектов старшего поколения при сжатии */
+  PHASE_COMPACT, /** Вычисление новых адресов, обновление ссылок и сдвиг объектов при сжатии */
+  PHASE_SWEEP, /** Ленивое подметание неперемещающего старшего поколения (идет во время повышения объектов) */
+  PHASE_COUNT
+};
+
+/** Кол-во корзин гистограммы на каждую степень двойки */
+#define PAUSE_SUB_BUCKETS 8
+#define PAUSE_BUCKETS (64 * PAUSE_SUB_BUCKETS)
+
+/** Гистограмма длительностей пауз в наносекундах.
+ * Корзины логарифмические (по PAUSE_SUB_BUCKETS на степень двойки), так что перцентили считаются с точностью до 12.5%
+ * при фиксированном объеме памяти, сколько бы сборок ни было */
+struct pause_histogram {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t buckets[PAUSE_BUCKETS];
+};
+
+/** Длительности всех пауз (вызовов gc_collect), сколько бы поколений ни собиралось в каждой */
+struct pause_histogram gc_pauses;
+/** Границы гистограммы пауз в статистике: степени двойки наносекунд (от ~1 мкс до ~1 с) */
+#define PAUSE_HISTOGRAM_MIN_EXPONENT 10
+#define PAUSE_HISTOGRAM_MAX_EXPONENT 30
 
 /** Структура поколения */
 struct generation {
   int number; /** Номер поколения */
-  int collect_count; /** Кол-во сборок */
+  uint64_t collect_count; /** Кол-во сборок */
+  uint64_t collected_bytes; /** Суммарный объем собираемых мест перед сборками */
+  uint64_t survived_bytes; /** Суммарный объем перенесенных (выживших или повышенных в поколении) объектов */
+
+  struct pause_histogram pauses; /** Длительности сборок поколения */
+  uint64_t phase_ns[PHASE_COUNT]; /** Суммарное время каждой фазы сборки */
 
   struct space* from; /** Место, где в первую очередь выделяется память */
   struct space* to; /** Место, куда переносятся в рамках копирующей сборки объекты */
+  struct space* survivor_from; /** Полупространства выживших (только у поколения 0, у остальных NULL) */
+  struct space* survivor_to; /** Сюда, а не в to, переносятся объекты моложе config.tenure_age */
 
   void* scan; /** Техническая переменная копирующей сборки мусора */
-} g0, g1;
+  void* survivor_scan; /** То же для survivor_to */
+};
+
+/** Статистика возрастов объектов поколения 0, переживших малую сборку */
+struct age_stats {
+  uint64_t survived_bytes[MAX_AGE + 1]; /** Объем переживших сборку в возрасте i (до ее начала) */
+  uint64_t kept_bytes[MAX_AGE + 1]; /** Объем оставленных в пространстве выживших с возрастом i */
+  uint64_t tenured_bytes; /** Повышено в поколение 1 по достижении config.tenure_age */
+  uint64_t overflow_bytes; /** Повышено раньше срока, потому что не поместилось в пространство выживших */
+} age_stats;
+
+/** Состояние адаптивного выбора размера поколения 0 (см. adapt_nursery) */
+struct nursery_policy {
+  double survival; /** Сглаженная доля выживших в малой сборке */
+  double ns_per_survived_byte; /** Сглаженная стоимость переноса одного выжившего байта (вместе с корнями и картами) */
+  double gc_share; /** Сглаженная доля времени на малые сборки (от конца прошлой малой сборки до конца текущей) */
+  uint64_t last_end_ns; /** Конец прошлой малой сборки */
+  size_t min_size; /** Наименьший и наибольший размер поколения 0 за время работы */
+  size_t max_size;
+  uint64_t resizes; /** Кол-во изменений размера */
+  uint64_t samples; /** Кол-во учтенных малых сборок */
+} nursery_policy;
+
+/** Вес нового замера в сглаженных значениях */
+#define NURSERY_SMOOTHING 0.3
+
+/** Стек объектов (растет по мере надобности и сохраняется между сборками) */
+struct object_stack {
+  struct gc_object** items;
+  size_t size;
+  size_t capacity;
+};
+
+/** Стек пометки старшего поколения при сжатии и при mark-sweep */
+struct object_stack mark_stack;
+/** Повышенные в неперемещающее старшее поколение и еще не просканированные объекты (они лежат не подряд) */
+struct object_stack promoted;
+/** Повышать всех выживших, не оставляя их в пространстве выживших (перед сжатием старшего поколения) */
+bool tenure_all = false;
+
+/** Массив двусторонней очереди: кольцевой, емкость - степень двойки */
+struct deque_buffer {
+  size_t capacity;
+  struct deque_buffer* retired; /** Прежний массив (воры еще могут читать из него), освобождается после сборки */
+  struct gc_object* items[];
+};
+
+/** Двусторонняя очередь серых объектов (Chase-Lev): владелец кладет и берет объекты с конца bottom,
+ * остальные потоки крадут их с начала top */
+struct gc_deque {
+  struct deque_buffer* buffer;
+  int64_t top;
+  int64_t bottom;
+};
+
+/** Поток параллельной сборки старшего поколения */
+struct gc_worker {
+  _Alignas(64) struct gc_deque deque; /** Очереди потоков лежат в разных строках кэша */
+  pthread_t thread;
+  void* plab_next; /** Свободная часть буфера переноса (PLAB), который поток взял из to */
+  void* plab_end;
+  size_t objects; /** Кол-во перенесенных потоком объектов */
+  uint64_t steals; /** Кол-во объектов, украденных из чужих очередей */
+  unsigned int seed; /** Состояние генератора, выбирающего, у кого красть */
+};
 
-int generation_count = 2;
-struct generation* generations[] = { &g0, &g1 };
+/** Пул потоков параллельной сборки: потоки запускаются при первой такой сборке и ждут следующих,
+ * а поток с номером 0 - сам мутатор */
+struct gc_pool {
+  int count; /** Кол-во потоков вместе с мутатором (0, пока пул не запущен) */
+  struct gc_worker* workers;
+  struct generation* g; /** Собираемое поколение */
+  pthread_mutex_t lock;
+  pthread_cond_t start; /** Сигнал потокам о начале сборки (увеличивается epoch) */
+  pthread_cond_t done; /** Сигнал мутатору, что все потоки закончили */
+  uint64_t epoch; /** Номер параллельной сборки */
+  int running; /** Кол-во потоков, еще не закончивших текущую сборку */
+  int idle; /** Кол-во потоков без работы: сборка закончена, когда простаивают все */
+  uint64_t collections; /** Кол-во параллельных сборок */
+  uint64_t steals; /** Всего украдено объектов */
+} gc_pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .start = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+/** Состояние инкрементальной сборки старшего поколения (по Бейкеру).
+ * Во время сборки g_old->from - новое полупространство, а g_old->to - собираемое, из которого объекты
+ * переносятся по мере сканирования (указатель g_old->scan) или когда мутатор читает ссылку на них */
+struct incremental {
+  bool active; /** Идет ли сборка */
+  size_t copied_bytes; /** Перенесено из собираемого полупространства за текущую сборку */
+  void* step_next; /** Конец занятой части нового полупространства после прошлого шага: все выше - новый долг сканирования */
+  uint64_t cycles; /** Кол-во начатых сборок */
+  uint64_t steps; /** Кол-во шагов сканирования */
+  uint64_t barrier_copies; /** Кол-во объектов, перенесенных барьером на чтение */
+  uint64_t forced; /** Кол-во сборок, доделанных в одну паузу, потому что повышению не хватило места */
+} incremental;
+
+/** Поколения от младшего к старшему (выделяются в init_generation по config.generation_count).
+ * Сборка поколения переносит выживших из него и всех младших в следующее, а старшее копирует между полупространствами */
+int generation_count = 0;
+struct generation** generations = NULL;
+struct generation* g0 = NULL;
+struct generation* g_old = NULL;
 
 // common funcs
 
 // Выделяет первоначальные блоки памяти для поколений
 void init_generation();
+// Читает размер из переменной окружения (допускаются суффиксы K/M/G), 0 - допустимое значение
+size_t env_size(const char* name, size_t default_value);
+// То же для размеров, которые не могут быть нулевыми (0 считается ошибкой)
+size_t env_nonzero_size(const char* name, size_t default_value);
+// Читает неотрицательное целое без суффиксов из переменной окружения (кол-во, возраст, флаг)
+int env_count(const char* name, int default_value);
+// Читает число с плавающей точкой из переменной окружения
+double env_double(const char* name, double default_value);
+// Политика возврата страниц из переменной окружения (none, dontneed, free)
+gc_release_policy env_release(const char* name, gc_release_policy default_value);
+// Сборщик старшего поколения из переменной окружения (copying, compact)
+gc_old_collector env_old_collector(const char* name, gc_old_collector default_value);
 // Инициирует сборку мусора
 void gc_collect();
-// Обновление статистики по выделению памяти
-void alloc_stat_update(size_t size_in_bytes);
+// Хватит ли места в поколении next под все, что в него может перенести сборка младшего поколения
+bool has_promotion_room(const struct generation* next);
+// Суммарный размер поколений младше gen (вместе с пространством выживших) - столько сборка может в него перенести
+size_t younger_capacity(int gen);
+// Подбирает размер поколения 0 после малой сборки (если задана цель по паузам или по доле времени на сборку)
+void adapt_nursery(uint64_t pause_ns, uint64_t collected_bytes, uint64_t survived_bytes);
+// Обновление статистики по выделению памяти (учитывает все, что выделено быстрым путем)
+void alloc_stat_update();
+// Переносит указатель быстрого пути выделения и список помеченных барьером карт в структуры поколений
+void sync_heap();
+// Передает свободную часть поколения 0 быстрому пути выделения, а границы поколений - барьеру на запись
+void publish_heap();
 // Выход программы при неспособности выделить память
 void exit_with_out_memory_error();
+// Выход программы при переполнении или опустошении стека корней
+void exit_with_roots_error(const char* message);
+// Переходит на следующий кусок стека корней (выделяет его при необходимости)
+void push_root_chunk();
+// Возвращается на предыдущий кусок стека корней
+void pop_root_chunk();
+// Вызывает visit(ячейка, context) для каждой ячейки всех записей стека корней, начиная с последней записи
+void for_each_root(void (*visit)(void** slot, void* context), void* context);
 // Обновление статистики по сборке мусора
 void gc_collect_stat_update();
+// Обновление максимального объема живых данных (вызывается после сборки)
+void residency_stat_update();
+// Учет выживших и повышенных (переносимых в место to) объектов по тегам (при STELLA_RUNTIME_STATS)
+void tag_stat_update(const struct generation* g, const struct gc_object* p, const struct space* to);
+// Пиковый объем резидентной памяти процесса в байтах
+uint64_t peak_rss_bytes();
+// Записывает статистику в файл из STELLA_GC_STATS_FILE (JSON или CSV по STELLA_GC_STATS_FORMAT или расширению)
+void export_gc_stats();
 // Техническая функция красивого принта
 void print_separator();
+// Текущее время монотонных часов в наносекундах
+uint64_t now_ns();
+// Добавляет длительность паузы в гистограмму
+void pause_histogram_add(struct pause_histogram* histogram, uint64_t pause_ns);
+// Кол-во пауз гистограммы длительностью [2^exponent, 2^(exponent+1)) нс (крайние степени вбирают все, что за ними)
+uint64_t pause_histogram_bin(const struct pause_histogram* histogram, int exponent);
+// Оценка перцентиля percent (0..100) по гистограмме
+uint64_t pause_histogram_percentile(const struct pause_histogram* histogram, double percent);
+// Выводит статистику сборок поколения: паузы, фазы, выживаемость
+void print_generation_stats(const struct generation* g);
+// Выводит выживаемость по возрастам и объем повышенных объектов
+void print_age_stats();
 // Получает вес объекта stella
 size_t get_stella_object_size(const stella_object *obj);
 // Проверяет указывает ли переданный указатель в кучу
 bool is_in_heap(const void* ptr, const void* heap, size_t heap_size);
+// Номер поколения, в которое указывает указатель (-1, если ни в какое)
+int generation_of(const void* ptr);
 
 // gc_object
 
@@ -90,6 +404,14 @@ size_t get_gc_object_size(const struct gc_object *obj);
 struct gc_object* get_gc_object(void* st_ptr);
 // Получает указатель на объект stella по указателю на объект gc
 stella_object* get_stella_object(struct gc_object* gc_ptr);
+// Перенесен ли объект и куда
+bool is_forwarded(const struct gc_object* obj);
+struct gc_object* get_forwarded(const struct gc_object* obj);
+// Помечает объект перенесенным по адресу to
+void set_forwarded(struct gc_object* obj, struct gc_object* to);
+// Возраст объекта (кол-во пережитых малых сборок)
+int get_age(const struct gc_object* obj);
+void set_age(struct gc_object* obj, int age);
 
 // space
 
@@ -99,6 +421,44 @@ bool is_in_place(const struct space* space, const void* ptr);
 bool has_enough_space(const struct space* space, size_t requested_size);
 // Выделяет запрошенное число памяти в месте
 struct gc_object* alloc_in_space(struct space* space, size_t size_in_bytes);
+// Выделяет структуру места (без памяти под объекты)
+struct space* new_space();
+// Выделяет память под место заданного размера
+void alloc_space(struct space* space, int gen, size_t size);
+// Заполняет место поверх уже выделенной памяти heap
+void init_space(struct space* space, int gen, void* heap, size_t size);
+// Выделяет полупространства выживших поколения 0 и промежуточные поколения одним куском (барьеру на запись достаточно одной проверки)
+void alloc_young_spaces();
+// Округляет размер места вверх до выравнивания объектов: места, отображенные одним куском, идут друг за другом
+size_t align_size(size_t size);
+// Заменяет память пустого места на кусок нового размера
+void resize_space(struct space* space, size_t size);
+// Отображает (mmap) и освобождает обнуленную память под объекты поколения gen (при STELLA_COMPRESSED_REFS - ниже 4 ГиБ)
+void* alloc_heap(size_t size, int gen);
+void free_heap(void* heap, size_t size);
+// Совет madvise для освобождаемых страниц согласно config.release (-1 - страницы не возвращаются)
+int release_advice();
+// Возвращает ОС страницы мертвого полупространства согласно config.release
+void release_space(struct space* space);
+// Возвращает ОС целые страницы между start и end согласно config.release
+void release_range(void* start, void* end);
+// Увеличивает место на месте (память под него уже отображена с запасом), дополняя таблицу карт
+void extend_space(struct space* space, size_t size);
+// Запоминает в card_start начало объекта obj, если он первый в своей карте
+void note_object_start(struct space* space, const struct gc_object* obj);
+// Кол-во занятой памяти в месте
+size_t space_used(const struct space* space);
+// Кол-во свободной памяти в месте
+size_t space_free(const struct space* space);
+// Освобождает все место (объекты в нем больше не нужны)
+void reset_space(struct space* space);
+// Кол-во карт, покрывающих место
+size_t space_card_count(const struct space* space);
+// Пробегает объекты помеченных карт места и переносит их поля из собираемого поколения
+// (карта остается помеченной, если ее объекты ссылаются на переживших сборку в пространстве выживших)
+void scan_dirty_cards(struct generation* g, struct space* space);
+// Помечает карту места, в которой лежит ptr
+void mark_card(struct space* space, const void* ptr);
 // Выводит текущее состояние места
 void print_space(const struct space* space);
 
@@ -113,408 +473,2774 @@ void collect(struct generation* g);
 // Функции реализовывающие копирующую сборку мусора
 bool chase(struct generation* g, struct gc_object *p);
 void* forward(struct generation* g, void* p);
+// Переносит поля объекта поколения gen, возвращает, остались ли в нем ссылки в более молодые поколения
+bool forward_fields(struct generation* g, struct gc_object* obj, int gen);
+// Указывает ли ptr после сборки поколения g в поколение младше gen (в пространство выживших или несобранное поколение)
+bool is_younger(const struct generation* g, const void* ptr, int gen);
+// Выбирает место, куда переносится объект: пространство выживших или следующее поколение
+struct space* destination(const struct generation* g, const struct gc_object* p, size_t size);
+// Проверяет, что указатель указывает в поколение g или более молодое (они собираются вместе)
+bool is_collected(const struct generation* g, const void* ptr);
+// Увеличивает полупространства поколения, если после сборки, оставившей live живых байт, в нем не осталось резерва
+void grow_generation(struct generation* g, size_t live);
+// Размер полупространства поколения, в котором после переноса live байт останется резерв под младшие поколения
+size_t reserved_size(const struct generation* g, size_t live);
+// Номер поколения для сборки: самое молодое, в следующее за которым поместится все, что эта сборка может в него перенести
+int generation_to_collect();
+
+// mark-compact
+
+// Собирает старшее поколение сжатием на месте (Lisp-2): младшие поколения сначала повышаются в него целиком,
+// затем живые объекты помечаются, получают новые адреса по порядку и сдвигаются к началу места
+void compact_generation(struct generation* g);
+// Помечает объекты места space, достижимые из корней, возвращает их кол-во (объем прибавляется к *bytes)
+size_t mark_roots(struct space* space, size_t* bytes);
+// Помечает объект места space по указателю ptr и все достижимые из него, возвращает кол-во новых помеченных объектов
+size_t mark_from(struct space* space, void* ptr, size_t* bytes);
+void mark_push(struct space* space, void* ptr, size_t* marked, size_t* bytes);
+// Пометка хранится в заголовке объекта, а у места со списками свободных ячеек - в битовой карте
+bool is_marked(const struct space* space, const struct gc_object* obj);
+void set_marked(struct space* space, struct gc_object* obj);
+void push_object(struct object_stack* stack, struct gc_object* obj);
+// Новый адрес объекта места space после сжатия (записан в его первое поле), остальные указатели не меняются
+void* compacted_address(const struct space* space, void* ptr);
+
+// mark-sweep
+
+// Собирает старшее поколение без перемещения: младшие поколения повышаются в него целиком, живые объекты
+// помечаются в битовой карте, а мертвые попадают в списки свободных ячеек позже, при подметании по требованию
+void sweep_generation(struct generation* g);
+// Заводит списки свободных ячеек и битовую карту пометки у места
+void init_free_lists(struct space* space);
+// Размер битовой карты пометки места в байтах
+size_t mark_bitmap_size(const struct space* space);
+// Выделяет ячейку под объект: из списка ячеек того же размера, из большей ячейки или сдвигом next
+// (еще не подметенная часть места подметается кусками, пока подходящей ячейки нет)
+struct gc_object* alloc_cell(struct space* space, size_t size);
+// Берет из списков ячейку размера size (большая ячейка делится, остаток возвращается в списки)
+struct gc_object* take_cell(struct space* space, size_t size);
+// Превращает память [cell, cell + size) в свободную ячейку и кладет ее в список
+void free_cell(struct space* space, struct gc_object* cell, size_t size);
+// Подметает не меньше quantum байт места (до конца очередной цепочки мертвых объектов)
+void sweep_space(struct space* space, size_t quantum);
+// Отдает цепочку подряд идущих мертвых объектов [start, end) спискам (или next, если она в конце места)
+void free_run(struct space* space, void* start, void* end);
+// Размер очередной ячейки при нарезке промежутка длины left: наибольший, но так, чтобы остаток тоже был ячейкой
+size_t next_cell_size(size_t left);
+
+// parallel copying
+
+// Собирается ли поколение параллельно: копирующая сборка старшего поколения, когда задано несколько потоков
+bool is_parallel(const struct generation* g);
+// Запускает потоки пула (один раз, при первой параллельной сборке) и готовит их к сборке поколения g
+void start_workers(struct generation* g);
+// Тело потока пула: ждет начала очередной сборки и участвует в ней
+void* worker_main(void* arg);
+// Сканирует серые объекты всеми потоками пула, пока их очереди не опустеют (корни уже перенесены мутатором)
+void parallel_scan(struct generation* g);
+// Работа одного потока: сканирует объекты своей очереди, а когда она пуста - крадет из чужих
+void parallel_work(struct gc_worker* worker);
+// Ждет появления работы в чужих очередях, возвращает false, когда простаивают все потоки (сборка закончена)
+bool await_work(struct gc_worker* worker);
+// Крадет объект из очереди другого потока (NULL, если красть нечего)
+struct gc_object* steal_work(struct gc_worker* worker);
+// Переносит объект по указателю p: копирует его поток, первым выставивший COPYING в заголовке (CAS),
+// остальные дожидаются нового адреса. Новая копия с указателями возвращается в *grey (иначе там NULL)
+void* parallel_forward(struct generation* g, struct gc_worker* worker, void* p, struct gc_object** grey);
+// Переносит корень: копия кладется в очередь мутатора, откуда ее разбирают потоки пула
+void* parallel_forward_root(struct generation* g, void* p);
+// Выделяет место под объект в буфере переноса потока, а когда он кончается, берет из места следующий
+struct gc_object* plab_alloc(struct space* space, struct gc_worker* worker, size_t size);
+// Закрывает остаток буфера переноса мертвыми ячейками, чтобы место можно было пройти по объектам
+void plab_retire(struct space* space, struct gc_worker* worker);
+// То же, что note_object_start, когда объекты в одной карте могут появляться из разных потоков
+void note_object_start_atomic(struct space* space, const struct gc_object* obj);
+// Двусторонняя очередь серых объектов потока (кладет и берет с конца только владелец)
+void deque_init(struct gc_deque* deque);
+void deque_push(struct gc_deque* deque, struct gc_object* obj);
+struct gc_object* deque_pop(struct gc_deque* deque);
+// Крадет объект с начала очереди (NULL, если она пуста или объект забрал другой поток)
+struct gc_object* deque_steal(struct gc_deque* deque);
+bool deque_is_empty(struct gc_deque* deque);
+// Освобождает прежние массивы очереди (после сборки, когда воров уже нет)
+void deque_release_retired(struct gc_deque* deque);
+
+// incremental copying
+
+// Начинает инкрементальную сборку старшего поколения: младшие поколения повышаются в него целиком,
+// полупространства меняются местами, и переносятся только объекты, на которые указывают корни
+void incremental_start(struct generation* g);
+// Сканирует не меньше quantum байт нового полупространства (до конца объекта), заканчивает сборку, когда сканировать нечего
+void incremental_step(struct generation* g, size_t quantum);
+// Освобождает собранное полупространство и растит поколение
+void incremental_finish(struct generation* g);
+// Переносит объект собираемого полупространства по указателю p в новое (без chase, чтобы шаг был ограничен)
+void* incremental_forward(struct generation* g, void* p);
 
 // public
-void* gc_alloc(const size_t size_in_bytes) {
+void gc_init(const gc_config *cfg) {
+  if (g0 != NULL) return;
+
+  if (cfg != NULL) {
+    config = *cfg;
+  }
+
+  if (config.nursery_size == 0) {
+    config.nursery_size = env_nonzero_size("STELLA_GC_NURSERY_SIZE", MAX_ALLOC_SIZE);
+  }
+  if (config.generation_count <= 0) {
+    config.generation_count = env_count("STELLA_GC_GENERATIONS", GENERATION_COUNT);
+  }
+  if (config.generation_ratio <= 1.0) {
+    config.generation_ratio = env_double("STELLA_GC_GENERATION_RATIO", GEN_SIZE_MULTIPLIER);
+  }
+  // поколение должно вмещать хотя бы все, что в него переносит сборка предыдущего (с пространством выживших)
+  if (config.generation_ratio < 2.0) {
+    config.generation_ratio = GEN_SIZE_MULTIPLIER;
+  }
+  if (config.generation_count < 2) {
+    config.generation_count = 2;
+  }
+  if (config.generation_count > MAX_GENERATIONS) {
+    config.generation_count = MAX_GENERATIONS;
+  }
+  if (config.old_size == 0) {
+    double old_size = config.nursery_size;
+    for (int i = 1; i < config.generation_count; i++) {
+      old_size *= config.generation_ratio;
+    }
+    config.old_size = env_nonzero_size("STELLA_GC_OLD_SIZE", old_size);
+  }
+  if (config.max_old_size == 0) {
+    config.max_old_size = env_nonzero_size("STELLA_GC_MAX_OLD_SIZE", MAX_OLD_SIZE);
+  }
+  if (config.growth_factor <= 1.0) {
+    config.growth_factor = env_double("STELLA_GC_GROWTH_FACTOR", GROWTH_FACTOR);
+  }
+  if (config.old_collector == GC_OLD_DEFAULT) {
+    config.old_collector = env_old_collector("STELLA_GC_OLD_COLLECTOR", GC_OLD_COPYING);
+  }
+  if (config.release == GC_RELEASE_DEFAULT) {
+    config.release = env_release("STELLA_GC_RELEASE", GC_RELEASE_DONTNEED);
+  }
+  if (config.huge_pages == 0) {
+    config.huge_pages = env_count("STELLA_GC_HUGE_PAGES", 0) != 0;
+  }
+  if (config.prefault == 0) {
+    config.prefault = env_count("STELLA_GC_PREFAULT", 0) != 0;
+  }
+  if (config.pause_target_us <= 0) {
+    config.pause_target_us = env_double("STELLA_GC_PAUSE_TARGET", 0);
+  }
+  if (config.gc_time_goal <= 0) {
+    config.gc_time_goal = env_double("STELLA_GC_TIME_GOAL", 0);
+  }
+  if (config.min_nursery_size == 0) {
+    config.min_nursery_size = env_nonzero_size("STELLA_GC_MIN_NURSERY_SIZE", MIN_NURSERY_SIZE);
+  }
+  if (config.max_nursery_size == 0) {
+    config.max_nursery_size = env_nonzero_size("STELLA_GC_MAX_NURSERY_SIZE", config.max_old_size / 4);
+  }
+  if (config.survivor_size == 0) {
+    config.survivor_size = env_nonzero_size("STELLA_GC_SURVIVOR_SIZE", config.nursery_size / SURVIVOR_RATIO);
+  }
+  if (config.tenure_age <= 0) {
+    config.tenure_age = env_count("STELLA_GC_TENURE_AGE", TENURE_AGE);
+  }
+  if (config.gc_threads <= 0) {
+    config.gc_threads = env_count("STELLA_GC_THREADS", 1);
+  }
+  if (config.incremental_quantum == 0) {
+    config.incremental_quantum = env_size("STELLA_GC_INCREMENTAL_QUANTUM", 0);
+  }
+
+  // объекты старше MAX_AGE в заголовке не помещаются, а возраст 1 означает повышение при первой же сборке
+  if (config.tenure_age > MAX_AGE) {
+    config.tenure_age = MAX_AGE;
+  }
+  if (config.tenure_age < 1) {
+    config.tenure_age = 1;
+  }
+  if (config.gc_threads < 1) {
+    config.gc_threads = 1;
+  }
+  if (config.gc_threads > MAX_GC_THREADS) {
+    config.gc_threads = MAX_GC_THREADS;
+  }
+#ifdef STELLA_GC_NO_STATS
+  // в этом профиле сборки барьера на чтение нет, а без него мутатор увидит собираемое полупространство
+  config.incremental_quantum = 0;
+#endif
+  if (config.old_collector != GC_OLD_COPYING) {
+    config.incremental_quantum = 0;
+  }
+  if (config.survivor_size < sizeof(stella_object) + sizeof(stella_ref)) {
+    config.survivor_size = sizeof(stella_object) + sizeof(stella_ref);
+  }
+  config.survivor_size = align_size(config.survivor_size);
+
+  if (config.growth_factor <= 1.0) {
+    config.growth_factor = GROWTH_FACTOR;
+  }
+  // Полупространство старшего поколения держит резерв под два поколения 0, поэтому больше четверти его предела оно не растет
+  if (config.max_nursery_size > config.max_old_size / 4) {
+    config.max_nursery_size = config.max_old_size / 4;
+  }
+  if (config.min_nursery_size > config.nursery_size) {
+    config.min_nursery_size = config.nursery_size;
+  }
+  if (config.max_nursery_size < config.nursery_size) {
+    config.max_nursery_size = config.nursery_size;
+  }
+  nursery_policy.min_size = config.nursery_size;
+  nursery_policy.max_size = config.nursery_size;
+
+#ifdef STELLA_COMPRESSED_REFS
+  // 32-битные ссылки хранят и адреса функций и статических объектов, а они ниже 4 ГиБ только без PIE
+  if ((uintptr_t)&the_ZERO > UINT32_MAX || (uintptr_t)&gc_init > UINT32_MAX) {
+    printf("Compressed references require a non-PIE build (-no-pie)!");
+    exit(1);
+  }
+#endif
+
+  gc_start_time_ns = now_ns();
   init_generation();
+  atexit(export_gc_stats);
+}
+
+void* gc_alloc_slow(const size_t size_in_bytes) {
+  if (g0 == NULL) {
+    gc_init(NULL);
+  }
+
+  sync_heap();
+  alloc_stat_update();
 
-  void *result = try_alloc(&g0, size_in_bytes);
+  void *result = try_alloc(g0, size_in_bytes);
   if (result == NULL) {
     gc_collect();
 
-    result = try_alloc(&g0, size_in_bytes);
+    result = try_alloc(g0, size_in_bytes);
   }
 
-  if (result != NULL) {
-    alloc_stat_update(size_in_bytes);
-  } else {
+  if (result == NULL) {
     exit_with_out_memory_error();
   }
 
+#ifndef STELLA_GC_NO_STATS
+  gc_nursery_objects++;
+#endif
+  publish_heap();
+
   return result;
 }
 
+void* gc_alloc_n_slow(size_t *count, const size_t size_in_bytes) {
+  if (g0 == NULL) {
+    gc_init(NULL);
+  }
+
+  sync_heap();
+  alloc_stat_update();
+
+  // собираем мусор, только если в поколение 0 не влезает та часть блока, которая влезла бы в пустое поколение 0
+  const size_t size = size_in_bytes + GC_OBJECT_HEADER_SIZE;
+  const size_t capacity = g0->from->size / size;
+  const size_t wanted = *count < capacity ? *count : capacity;
+  if (space_free(g0->from) / size < wanted || wanted == 0) {
+    gc_collect();
+  }
+
+  const size_t fit = space_free(g0->from) / size;
+  if (fit == 0) {
+    exit_with_out_memory_error();
+  }
+  if (*count > fit) {
+    *count = fit;
+  }
+
+  struct gc_object *result = alloc_in_space(g0->from, size_in_bytes);
+  g0->from->next += (*count - 1) * size;
+  g0->from->objects += *count - 1;
+
+#ifndef STELLA_GC_NO_STATS
+  gc_nursery_objects += *count;
+#endif
+  publish_heap();
+
+  return get_stella_object(result);
+}
+
 void gc_read_barrier(void *object, int field_index) {
   total_reads += 1;
+
+  // мутатор не должен увидеть ссылку в собираемое полупространство: объект переносится, а поле обновляется до чтения
+  if (incremental.active) {
+    stella_object* obj = object;
+    if (field_index < STELLA_OBJECT_HEADER_POINTER_COUNT(obj->object_header)) {
+      void* field = STELLA_REF_DECODE(obj->object_fields[field_index]);
+      if (is_in_place(g_old->to, field)) {
+        obj->object_fields[field_index] = STELLA_REF_ENCODE(incremental_forward(g_old, field));
+        incremental.barrier_copies++;
+      }
+    }
+  }
 }
 
 void gc_write_barrier(void *object, int field_index, void *contents) {
   total_writes += 1;
 
-  changed_nodes[changed_nodes_top] = object;
-  changed_nodes_top++;
+  gc_remember(object, contents);
 }
 
 void gc_push_root(void **ptr){
-  gc_roots[gc_roots_top++] = ptr;
-  if (gc_roots_top > gc_roots_max_size) { gc_roots_max_size = gc_roots_top; }
+  gc_push_frame(ptr, 1);
 }
 
 void gc_pop_root(void **ptr){
-  gc_roots_top--;
+  gc_pop_frame();
+}
+
+void gc_push_frame(void **slots, const int count){
+  if (gc_roots_top == ROOT_CHUNK_SIZE) { push_root_chunk(); }
+  struct root_frame *frame = &gc_roots->frames[gc_roots_top++];
+  frame->slots = slots;
+  frame->count = count;
+
+  gc_roots_size += count;
+  if (gc_roots_size > gc_roots_max_size) { gc_roots_max_size = gc_roots_size; }
+}
+
+void gc_pop_frame(){
+  // до первого gc_push_frame кусков нет вовсе (gc_roots_top при этом равен ROOT_CHUNK_SIZE)
+  if (gc_roots_top == 0 || gc_roots == NULL) { pop_root_chunk(); }
+  gc_roots_size -= gc_roots->frames[--gc_roots_top].count;
 }
 
 void print_gc_alloc_stats() {
+  sync_heap();
+  alloc_stat_update();
+
   print_separator();
   printf("STATS\n");
   print_separator();
 
-  printf("Total memory requested:   %d bytes (%d objects)\n", total_requested_bytes, total_allocated_objects);
-  printf("Total memory allocation:  %d bytes (%d objects)\n", total_allocated_bytes, total_allocated_objects);
-  printf("Total garbage collecting: %d. G_0: %d. G_1: %d\n", total_gc_collect, g0.collect_count, g1.collect_count);
-  printf("Maximum residency:        %d bytes (%d objects)\n", max_allocated_bytes, max_allocated_objects);
-  printf("Total memory use:         %d reads and %d writes\n", total_reads, total_writes);
-  printf("Max GC roots stack size:  %d roots\n", gc_roots_max_size);
+#ifdef STELLA_GC_NO_STATS
+  // объекты, чтения и записи в этом профиле сборки не считаются
+  printf("Total memory allocation:  %" PRIu64 " bytes\n", total_allocated_bytes);
+#else
+  printf("Total memory requested:   %" PRIu64 " bytes (%" PRIu64 " objects)\n", total_requested_bytes, total_allocated_objects);
+  printf("Total memory allocation:  %" PRIu64 " bytes (%" PRIu64 " objects)\n", total_allocated_bytes, total_allocated_objects);
+#endif
+  printf("Total garbage collecting: %" PRIu64, total_gc_collect);
+  for (int i = 0; i < generation_count; i++) {
+    printf(". G_%d: %" PRIu64, i, generations[i]->collect_count);
+  }
+  printf("\n");
+  printf("Maximum residency:        %" PRIu64 " bytes (%" PRIu64 " objects)\n", max_residency_bytes, max_residency_objects);
+  printf("Peak RSS:                 %" PRIu64 " bytes (%" PRIu64 " bytes of dead semispaces released)\n", peak_rss_bytes(), total_released_bytes);
+#ifdef STELLA_GC_NO_STATS
+  printf("Total memory use:         not counted (STELLA_GC_NO_STATS)\n");
+#else
+  printf("Total memory use:         %" PRIu64 " reads and %" PRIu64 " writes\n", total_reads, total_writes);
+#endif
+  printf("Max GC roots stack size:  %" PRIu64 " roots\n", gc_roots_max_size);
+
+  const uint64_t wall_ns = now_ns() - gc_start_time_ns;
+  printf("Total GC time:            %.3f ms (%.2f%% of %.3f ms wall time)\n",
+         total_gc_time_ns / 1e6,
+         wall_ns == 0 ? 0.0 : 100.0 * total_gc_time_ns / wall_ns,
+         wall_ns / 1e6);
+  printf("All pauses (us):          count %" PRIu64 " | p50 %.1f | p99 %.1f | max %.1f\n",
+         gc_pauses.count,
+         pause_histogram_percentile(&gc_pauses, 50) / 1e3,
+         pause_histogram_percentile(&gc_pauses, 99) / 1e3,
+         gc_pauses.max_ns / 1e3);
+  if (gc_pauses.count > 0) {
+    printf("All pauses histogram:     ");
+    const char* separator = "";
+    for (int exponent = PAUSE_HISTOGRAM_MIN_EXPONENT; exponent <= PAUSE_HISTOGRAM_MAX_EXPONENT; exponent++) {
+      const uint64_t pauses = pause_histogram_bin(&gc_pauses, exponent);
+      if (pauses == 0) continue;
+      if (exponent == PAUSE_HISTOGRAM_MAX_EXPONENT) {
+        printf("%s>=2^%d ns: %" PRIu64, separator, exponent, pauses);
+      } else {
+        printf("%s<2^%d ns: %" PRIu64, separator, exponent + 1, pauses);
+      }
+      separator = " | ";
+    }
+    printf("\n");
+  }
+  for (int i = 0; i < generation_count; i++) {
+    print_generation_stats(generations[i]);
+    if (generations[i] != g0) continue;
+
+    printf("G_0 nursery size:         %zu bytes (min %zu, max %zu, %" PRIu64 " resizes)",
+           config.nursery_size, nursery_policy.min_size, nursery_policy.max_size, nursery_policy.resizes);
+    if (config.pause_target_us > 0 || config.gc_time_goal > 0) {
+      printf(" | survival %.2f%% | GC time %.2f%%", 100.0 * nursery_policy.survival, 100.0 * nursery_policy.gc_share);
+    }
+    printf("\n");
+    print_age_stats();
+  }
 
   print_separator();
 }
 
 void print_gc_state() {
-  print_state(&g0);
-  print_state(&g1);
+  sync_heap();
+
+  for (int i = 0; i < generation_count; i++) {
+    print_state(generations[i]);
+  }
   print_gc_roots();
 }
 
+static void print_root(void** slot, void* context) {
+  int *index = context;
+  char from[16];
+  const int gen = generation_of(*slot);
+  if (gen >= 0) {
+    snprintf(from, sizeof(from), "G_%d", gen);
+  } else {
+    snprintf(from, sizeof(from), "OTHER");
+  }
+  printf(
+    "\tIDX: %-5d | ADDRESS: %-15p | FROM: %-5s | VALUE: %-15p\n",
+    (*index)++,
+    slot,
+    from,
+    *slot
+  );
+}
+
 void print_gc_roots() {
   printf("ROOTS:\n");
   print_separator();
 
-  for (int i = 0; i < gc_roots_top; i++) {
-    printf(
-      "\tIDX: %-5d | ADDRESS: %-15p | FROM: %-5s | VALUE: %-15p\n",
-      i,
-      gc_roots[i],
-      is_in_place(g0.from, *gc_roots[i])
-        ? "G_0"
-        : is_in_place(g1.from, *gc_roots[i])
-          ? "G_1"
-          : "OTHER",
-      *gc_roots[i]
-    );
-  }
+  // корни нумеруются от вершины стека
+  int index = 0;
+  for_each_root(print_root, &index);
 
   print_separator();
 }
 
 // common
 void init_generation() {
-  if (g0.from != NULL) return;
+  if (g0 != NULL) return;
 
-  g0_space_from.gen = 0;
-  g0_space_from.size = MAX_ALLOC_SIZE;
-  g0_space_from.heap = malloc(MAX_ALLOC_SIZE);
-  g0_space_from.next = g0_space_from.heap;
+  generation_count = config.generation_count;
+  generations = calloc(generation_count, sizeof(struct generation*));
+  if (generations == NULL) {
+    exit_with_out_memory_error();
+  }
+  for (int i = 0; i < generation_count; i++) {
+    generations[i] = calloc(1, sizeof(struct generation));
+    if (generations[i] == NULL) {
+      exit_with_out_memory_error();
+    }
+    generations[i]->number = i;
+  }
+  g0 = generations[0];
+  g_old = generations[generation_count - 1];
 
-  const int g1_space_size = MAX_ALLOC_SIZE * GEN_SIZE_MULTIPLIER;
-  g1_space_from.gen = 1;
-  g1_space_from.size = g1_space_size;
-  g1_space_from.heap = malloc(g1_space_size);
-  g1_space_from.next = g1_space_from.heap;
-  g1_space_to.gen = 1;
-  g1_space_to.size = g1_space_size;
-  g1_space_to.heap = malloc(g1_space_size);
-  g1_space_to.next = g1_space_to.heap;
+  g0->from = new_space();
+  alloc_space(g0->from, 0, config.nursery_size);
+  alloc_young_spaces();
 
-  g0.number = 0;
-  g0.from = &g0_space_from;
-  g0.to = &g1_space_from;
+  // Полупространство старшего поколения должно вмещать хотя бы заполненные младшие поколения и резерв под их перенос
+  const size_t reserve = younger_capacity(g_old->number);
+  if (config.old_size < 2 * reserve) {
+    config.old_size = 2 * reserve;
+  }
+  if (config.max_old_size < config.old_size) {
+    config.max_old_size = config.old_size;
+  }
+  g_old->from = new_space();
+  if (config.old_collector == GC_OLD_COMPACT || config.old_collector == GC_OLD_SWEEP) {
+    // сборка идет на месте и второе полупространство не нужно: сразу отображаем весь предел и растем внутри него
+    // (если столько адресов не нашлось, например ниже 4 ГиБ при 32-битных ссылках, предел уменьшается)
+    void* heap;
+    while ((heap = alloc_heap(config.max_old_size, g_old->number)) == NULL && config.max_old_size / 2 >= config.old_size) {
+      config.max_old_size /= 2;
+    }
+    init_space(g_old->from, g_old->number, heap, config.old_size);
+    if (config.old_collector == GC_OLD_SWEEP) {
+      init_free_lists(g_old->from);
+    }
+  } else {
+    g_old->to = new_space();
+    alloc_space(g_old->from, g_old->number, config.old_size);
+    alloc_space(g_old->to, g_old->number, config.old_size);
+  }
 
-  g1.number = 1;
-  g1.from = &g1_space_from;
-  g1.to = &g1_space_to;
+  // младшие поколения повышают выживших в следующее
+  for (int i = 0; i < generation_count - 1; i++) {
+    generations[i]->to = generations[i + 1]->from;
+  }
 }
 
-void alloc_stat_update(const size_t size_in_bytes) {
-  total_requested_bytes += size_in_bytes;
-  total_allocated_bytes += size_in_bytes + sizeof(void*);
-  total_allocated_objects += 1;
-  max_allocated_bytes = total_allocated_bytes;
-  max_allocated_objects = total_allocated_objects;
-}
+void alloc_stat_update() {
+  if (g0 == NULL) return;
 
-void gc_collect() {
-  collect(&g0);
+  const uint64_t allocated_bytes = g0->from->next - nursery_counted;
+  total_allocated_bytes += allocated_bytes;
+  total_requested_bytes += allocated_bytes - gc_nursery_objects * GC_OBJECT_HEADER_SIZE;
+  total_allocated_objects += gc_nursery_objects;
 
-#ifdef DEBUG_LOGS
-  printf("AFTER COLLECTING\n");
-  print_gc_state();
-#endif
+  nursery_counted = g0->from->next;
+  gc_nursery_objects = 0;
 }
 
-void print_separator() {
-  printf("=====================================================================================\n");
+void sync_heap() {
+  // во время сборки (например, при печати DEBUG_LOGS) актуальны как раз структуры поколений
+  if (gc_nursery_next != NULL && !collecting) {
+    g0->from->next = gc_nursery_next;
+    g_old->from->dirty_count = gc_old_dirty_count;
+  }
 }
 
-void gc_collect_stat_update() {
-  total_gc_collect += 1;
+void publish_heap() {
+  gc_nursery_start = g0->from->heap;
+  gc_nursery_next = g0->from->next;
+  gc_nursery_limit = g0->from->heap + g0->from->size;
+  // пространства выживших лежат в начале общего куска в любом порядке, промежуточные поколения - за ними
+  gc_young_start = g0->survivor_from->heap < g0->survivor_to->heap ? g0->survivor_from->heap : g0->survivor_to->heap;
+  gc_middle_start = gc_young_start + 2 * config.survivor_size;
+  gc_middle_end = g_old->number > 1 ? generations[g_old->number - 1]->from->heap + generations[g_old->number - 1]->from->size : gc_middle_start;
+  gc_young_end = gc_middle_end;
+
+  gc_old_start = g_old->from->heap;
+  gc_old_end = g_old->from->heap + g_old->from->size;
+  gc_old_cards = g_old->from->cards;
+  gc_old_dirty = g_old->from->dirty;
+  gc_old_dirty_count = g_old->from->dirty_count;
 }
 
-bool is_in_heap(const void* ptr, const void* heap, const size_t heap_size) {
-  return ptr >= heap && ptr < heap + heap_size;
-}
+size_t env_size(const char* name, const size_t default_value) {
+  const char* value = getenv(name);
+  if (value == NULL || *value == '\0') return default_value;
+
+  char* end;
+  size_t result = strtoull(value, &end, 10);
+  switch (*end) {
+    case 'g': case 'G': result <<= 10; /* fallthrough */
+    case 'm': case 'M': result <<= 10; /* fallthrough */
+    case 'k': case 'K': result <<= 10; end++; break;
+    default: break;
+  }
 
-void exit_with_out_memory_error() {
-  printf("Out of memory!");
-  exit(137);
-}
+  if (end == value || *end != '\0') {
+    fprintf(stderr, "Invalid value of %s: %s\n", name, value);
+    return default_value;
+  }
 
-// gc_object
-size_t get_stella_object_size(const stella_object *obj) {
-  const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->object_header);
-  return (1 + field_count) * sizeof(void*);
+  return result;
 }
 
-size_t get_gc_object_size(const struct gc_object *obj) {
-  const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->stella_object.object_header);
-  return (2 + field_count) * sizeof(void*);
-}
+size_t env_nonzero_size(const char* name, const size_t default_value) {
+  const size_t result = env_size(name, default_value);
+  if (result == 0) {
+    fprintf(stderr, "Invalid value of %s: %s\n", name, getenv(name));
+    return default_value;
+  }
 
-struct gc_object* get_gc_object(void* st_ptr) {
-  return st_ptr - sizeof(void*);
+  return result;
 }
 
-stella_object* get_stella_object(struct gc_object* gc_ptr) {
-  return &gc_ptr->stella_object;
-}
+int env_count(const char* name, const int default_value) {
+  const char* value = getenv(name);
+  if (value == NULL || *value == '\0') return default_value;
 
-// space
-bool is_in_place(const struct space* space, const void* ptr) {
-  return is_in_heap(ptr, space->heap, space->size);
-}
+  char* end;
+  const long result = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || result < 0 || result > INT_MAX) {
+    fprintf(stderr, "Invalid value of %s: %s\n", name, value);
+    return default_value;
+  }
 
-bool has_enough_space(const struct space* space, const size_t requested_size) {
-  return space->next + requested_size <= space->heap + space->size;
+  return result;
 }
 
-struct gc_object* alloc_in_space(struct space* space, const size_t size_in_bytes) {
-  const size_t size = size_in_bytes + sizeof(void*);
-  if (has_enough_space(space, size)) {
-    struct gc_object *result = space->next;
-    result->moved_to = NULL;
-    result->stella_object.object_header = 0;
-    space->next += size;
+double env_double(const char* name, const double default_value) {
+  const char* value = getenv(name);
+  if (value == NULL || *value == '\0') return default_value;
 
-    return result;
+  char* end;
+  const double result = strtod(value, &end);
+  if (end == value || *end != '\0') {
+    fprintf(stderr, "Invalid value of %s: %s\n", name, value);
+    return default_value;
   }
 
-  return NULL;
+  return result;
 }
 
-void print_space(const struct space* space) {
-  printf("OBJECTS:\n");
-  for (void *start = space->heap; start < space->next; start += get_gc_object_size(start)) {
-      const struct gc_object *gc_ptr = start;
-      const int tag = STELLA_OBJECT_HEADER_TAG(gc_ptr->stella_object.object_header);
-      printf("\tGC ADDRESS: %-15p | ST ADDRESS: %-15p | MOVED: %-15p | TAG: %-2d | FIELDS: ",
-             gc_ptr,
-             &gc_ptr->stella_object,
-             gc_ptr->moved_to,
-             tag);
+gc_old_collector env_old_collector(const char* name, const gc_old_collector default_value) {
+  const char* value = getenv(name);
+  if (value == NULL || *value == '\0') return default_value;
 
-      const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(gc_ptr->stella_object.object_header);
-      for (int i = 0; i < field_count; i++) {
-          printf("%-15p", gc_ptr->stella_object.object_fields[i]);
-          if (i < field_count - 1) {
-              printf(" ");
-          }
-      }
+  if (strcmp(value, "copying") == 0) return GC_OLD_COPYING;
+  if (strcmp(value, "compact") == 0) return GC_OLD_COMPACT;
+  if (strcmp(value, "sweep") == 0) return GC_OLD_SWEEP;
 
-      printf("\n");
-  }
+  fprintf(stderr, "Invalid value of %s: %s\n", name, value);
+  return default_value;
+}
 
-  // Кол-во выделенной памяти
-  printf("BOUNDARIES  | FROM: %-15p | TO: %-15p | TOTAL: %d bytes\n",
-         space->heap,
-         space->heap + space->size,
-         space->size);
-  printf("FREE MEMORY | FROM: %-15p | TO: %-15p | TOTAL: %ld bytes\n",
-         space->next,
-         space->heap + space->size,
-         space->heap + space->size - space->next);
+gc_release_policy env_release(const char* name, const gc_release_policy default_value) {
+  const char* value = getenv(name);
+  if (value == NULL || *value == '\0') return default_value;
+
+  if (strcmp(value, "none") == 0) return GC_RELEASE_NONE;
+  if (strcmp(value, "dontneed") == 0) return GC_RELEASE_DONTNEED;
+  if (strcmp(value, "free") == 0) return GC_RELEASE_FREE;
 
+  fprintf(stderr, "Invalid value of %s: %s\n", name, value);
+  return default_value;
 }
 
-// generation
-void print_state(const struct generation* g) {
-  print_separator();
-  printf("G_%d STATE\n", g->number);
-  print_separator();
+void gc_collect() {
+  const uint64_t start = now_ns();
+  collecting = true;
+
+  int number = generation_to_collect();
+  // инкрементальной сборке не хватило места под повышение: доделываем ее в этой паузе
+  if (incremental.active && generations[number] == g_old) {
+    incremental.forced++;
+    incremental_step(g_old, SIZE_MAX);
+    number = generation_to_collect();
+  }
 
-  printf("COLLECT COUNT %d\n", g->collect_count);
-  print_space(g->from);
+  // пауза считается одной сборкой запрошенного поколения, даже если по пути собираются и младшие
+  struct generation* g = generations[number];
+  g->collect_count++;
+  gc_collect_stat_update();
+  if (g == g_old) {
+    if (config.old_collector == GC_OLD_COMPACT) {
+      compact_generation(g);
+    } else if (config.old_collector == GC_OLD_SWEEP) {
+      sweep_generation(g);
+    } else if (config.incremental_quantum > 0) {
+      incremental_start(g);
+    } else {
+      collect(g);
+    }
+    // инкрементальная сборка растит поколение, когда закончится
+    if (!incremental.active) {
+      grow_generation(g, space_used(g->from));
+    }
+  } else if (g == g0) {
+    const uint64_t collected = g0->collected_bytes, survived = g0->survived_bytes;
+    collect(g0);
+    adapt_nursery(now_ns() - start, g0->collected_bytes - collected, g0->survived_bytes - survived);
+  } else {
+    collect(g);
+  }
 
-  if (g->to->gen == g->from->gen) {
-    printf("TO SPACE\n");
-    print_space(g->to);
+  // каждая пауза продвигает инкрементальную сборку на квант, но сканирует не меньше чем в INCREMENTAL_PACE раз больше,
+  // чем с прошлого шага добавилось в новое полупространство (повышение и барьер), иначе сканирование не догонит повышение
+  if (incremental.active) {
+    const size_t paced = INCREMENTAL_PACE * (size_t)(g_old->from->next - incremental.step_next);
+    incremental_step(g_old, paced > config.incremental_quantum ? paced : config.incremental_quantum);
   }
 
-  printf("SCAN: %-15p | NEXT: %-15p | LIMIT: %-15p\n", g->scan, g->to->next, g->to->heap + g->to->size);
+  // пока инкрементальная сборка идет, часть живых объектов еще лежит в собираемом полупространстве
+  if (!incremental.active) {
+    residency_stat_update();
+  }
+  collecting = false;
+  // указатели быстрого пути устарели: без этого sync_heap (например, в print_gc_state) вернул бы поколению 0 прежний next
+  publish_heap();
+  const uint64_t pause_ns = now_ns() - start;
+  total_gc_time_ns += pause_ns;
+  pause_histogram_add(&gc_pauses, pause_ns);
+  pause_histogram_add(&g->pauses, pause_ns);
 
-  print_separator();
+#ifdef DEBUG_LOGS
+  printf("AFTER COLLECTING\n");
+  print_gc_state();
+#endif
 }
 
-void* try_alloc(struct generation* g, const size_t size_in_bytes) {
-  void* allocated = alloc_in_space(g->from, size_in_bytes);
-  if (allocated == NULL) {
-    return NULL;
+int generation_to_collect() {
+  int number = 0;
+  while (number < generation_count - 1 && !has_promotion_room(generations[number + 1])) {
+    number++;
   }
 
-  return allocated + sizeof(void*);
+  return number;
 }
 
-bool chase(struct generation* g, struct gc_object *p) {
-  do {
-    struct gc_object *q = alloc_in_space(g->to, get_stella_object_size(&p->stella_object));
-    if (q == NULL) {
-      return false;
+bool has_promotion_room(const struct generation* next) {
+  size_t incoming = 0;
+  for (int i = 0; i < next->number; i++) {
+    incoming += space_used(generations[i]->from);
+    if (generations[i]->survivor_from != NULL) {
+      incoming += space_used(generations[i]->survivor_from);
     }
+  }
 
-    const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(p->stella_object.object_header);
-    void *r = NULL;
-
-    q->moved_to = NULL;
-    q->stella_object.object_header = p->stella_object.object_header;
-    for (int i = 0; i < field_count; i++) {
-      q->stella_object.object_fields[i] = p->stella_object.object_fields[i];
+  // В полупространстве старшего поколения держим еще и резерв размером со все младшие поколения:
+  // полная сборка переносит их вместе со старшим и должна поместиться в to
+  if (next == g_old) {
+    incoming += younger_capacity(next->number);
+    // и еще не перенесенные объекты собираемого полупространства, если инкрементальная сборка идет
+    if (incremental.active) {
+      incoming += space_used(next->to) - incremental.copied_bytes;
+    }
+  }
 
-      if (is_in_place(g->from, q->stella_object.object_fields[i])) {
-        struct gc_object *potentially_forwarded = get_gc_object(q->stella_object.object_fields[i]);
+  return space_used(next->from) + incoming <= next->from->size;
+}
 
-        if (!is_in_place(g->to, potentially_forwarded->moved_to)) {
-          r = potentially_forwarded;
-        }
-      }
+size_t younger_capacity(const int gen) {
+  size_t capacity = 0;
+  for (int i = 0; i < gen; i++) {
+    capacity += generations[i]->from->size;
+    if (generations[i]->survivor_from != NULL) {
+      capacity += generations[i]->survivor_from->size;
     }
+  }
 
-    p->moved_to = q;
-    p = r;
-  } while (p != NULL);
-
-  return true;
+  return capacity;
 }
 
-void* forward(struct generation* g, void* p) {
-  if (!is_in_place(g->from, p)) {
-    return p;
+void adapt_nursery(const uint64_t pause_ns, const uint64_t collected_bytes, const uint64_t survived_bytes) {
+  struct nursery_policy* policy = &nursery_policy;
+  const uint64_t end = now_ns();
+  const double elapsed = end - (policy->last_end_ns != 0 ? policy->last_end_ns : gc_start_time_ns);
+  policy->last_end_ns = end;
+
+  if (config.pause_target_us <= 0 && config.gc_time_goal <= 0) return;
+
+  const double survival = collected_bytes == 0 ? 0.0 : (double) survived_bytes / collected_bytes;
+  const double cost = (double) pause_ns / (survived_bytes > 0 ? survived_bytes : 1);
+  const double share = elapsed == 0 ? 0.0 : pause_ns / elapsed;
+  if (policy->samples++ == 0) {
+    policy->survival = survival;
+    policy->ns_per_survived_byte = cost;
+    policy->gc_share = share;
+  } else {
+    policy->survival += NURSERY_SMOOTHING * (survival - policy->survival);
+    policy->ns_per_survived_byte += NURSERY_SMOOTHING * (cost - policy->ns_per_survived_byte);
+    policy->gc_share += NURSERY_SMOOTHING * (share - policy->gc_share);
   }
 
-  struct gc_object* gc_object = get_gc_object(p);
+  // Пауза малой сборки пропорциональна объему выживших, а он - доле выживших, умноженной на размер поколения 0:
+  // при низкой выживаемости поколение 0 можно сильно увеличить, при высокой - нет
+  const size_t size = config.nursery_size;
+  const size_t grown = size * config.growth_factor;
+  const double target_ns = config.pause_target_us * 1e3;
+  const double pause_now = policy->ns_per_survived_byte * policy->survival * size;
+  const double pause_grown = policy->ns_per_survived_byte * policy->survival * grown;
+
+  size_t new_size = size;
+  if (target_ns > 0 && pause_now > target_ns) {
+    new_size = size / config.growth_factor;
+  } else if (target_ns <= 0 || pause_grown <= target_ns) {
+    // без цели по доле времени растем до цели по паузам, иначе - пока на сборки уходит больше заданной доли
+    if (config.gc_time_goal <= 0 || policy->gc_share > config.gc_time_goal) {
+      new_size = grown;
+    }
+  }
+
+  if (new_size < config.min_nursery_size) new_size = config.min_nursery_size;
+  if (new_size > config.max_nursery_size) new_size = config.max_nursery_size;
+  if (new_size == size) return;
+
+  // полная сборка переносит поколение 0 вместе со старшим, поэтому в to должно хватить места и под новое поколение 0,
+  // а промежуточное поколение 1 должно вмещать поколение 0 целиком
+  if (new_size > size) {
+    // во время инкрементальной сборки g_old->to - собираемое полупространство, а резерв в новом уже рассчитан
+    // на прежнее поколение 0, поэтому рост откладывается до конца цикла
+    if (incremental.active) return;
+    // инкрементальная сборка начинается с повышения младших поколений в from (а не в to), место под них должно быть там
+    if (config.incremental_quantum > 0
+        && space_used(g_old->from) + younger_capacity(g_old->number) - size + new_size > g_old->from->size) return;
+    if (g0->to != g_old->from && new_size + config.survivor_size > g0->to->size) return;
+    const size_t needed = space_used(g_old->from) + 2 * (younger_capacity(g_old->number) - size + new_size);
+    if (needed > config.max_old_size) return;
+    if (g_old->to == NULL) {
+      if (needed > g_old->from->size) {
+        extend_space(g_old->from, needed);
+      }
+    } else if (needed > g_old->to->size) {
+      resize_space(g_old->to, needed);
+    }
+  }
+
+  // поколение 0 после малой сборки пусто, его можно просто заменить
+  resize_space(g0->from, new_size);
+  config.nursery_size = new_size;
+  policy->resizes++;
+  if (new_size < policy->min_size) policy->min_size = new_size;
+  if (new_size > policy->max_size) policy->max_size = new_size;
+}
+
+void print_separator() {
+  printf("=====================================================================================\n");
+}
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void pause_histogram_add(struct pause_histogram* histogram, const uint64_t pause_ns) {
+  // значения меньше PAUSE_SUB_BUCKETS храним точно, остальные - по старшим битам
+  int bucket = pause_ns;
+  if (pause_ns >= PAUSE_SUB_BUCKETS) {
+    const int exponent = 63 - __builtin_clzll(pause_ns);
+    const int sub_bucket = (pause_ns >> (exponent - 3)) & (PAUSE_SUB_BUCKETS - 1);
+    bucket = (exponent - 2) * PAUSE_SUB_BUCKETS + sub_bucket;
+  }
+  histogram->buckets[bucket]++;
+
+  if (histogram->count == 0 || pause_ns < histogram->min_ns) histogram->min_ns = pause_ns;
+  if (pause_ns > histogram->max_ns) histogram->max_ns = pause_ns;
+  histogram->count++;
+  histogram->total_ns += pause_ns;
+}
+
+uint64_t pause_histogram_percentile(const struct pause_histogram* histogram, const double percent) {
+  if (histogram->count == 0) return 0;
+
+  const uint64_t rank = (uint64_t) (histogram->count * percent / 100.0 + 0.5);
+  uint64_t seen = 0;
+  for (int bucket = 0; bucket < PAUSE_BUCKETS; bucket++) {
+    seen += histogram->buckets[bucket];
+    if (seen >= rank && seen > 0) {
+      // нижняя граница корзины
+      uint64_t value = bucket;
+      if (bucket >= PAUSE_SUB_BUCKETS) {
+        const int exponent = bucket / PAUSE_SUB_BUCKETS + 2;
+        value = (uint64_t) (PAUSE_SUB_BUCKETS + bucket % PAUSE_SUB_BUCKETS) << (exponent - 3);
+      }
+      if (value < histogram->min_ns) value = histogram->min_ns;
+      if (value > histogram->max_ns) value = histogram->max_ns;
+      return value;
+    }
+  }
+
+  return histogram->max_ns;
+}
+
+uint64_t pause_histogram_bin(const struct pause_histogram* histogram, const int exponent) {
+  // корзины степени e >= 3 лежат с (e - 2) * PAUSE_SUB_BUCKETS, а значения меньше PAUSE_SUB_BUCKETS - в первых корзинах
+  const int first = exponent <= PAUSE_HISTOGRAM_MIN_EXPONENT ? 0 : (exponent - 2) * PAUSE_SUB_BUCKETS;
+  const int last = exponent >= PAUSE_HISTOGRAM_MAX_EXPONENT ? PAUSE_BUCKETS : (exponent - 1) * PAUSE_SUB_BUCKETS;
+  uint64_t pauses = 0;
+  for (int bucket = first; bucket < last; bucket++) {
+    pauses += histogram->buckets[bucket];
+  }
+
+  return pauses;
+}
+
+void print_generation_stats(const struct generation* g) {
+  const struct pause_histogram* pauses = &g->pauses;
+  printf("G_%d pauses (us):          count %" PRIu64 " | min %.1f | p50 %.1f | p99 %.1f | max %.1f | total %.3f ms\n",
+         g->number,
+         pauses->count,
+         pauses->min_ns / 1e3,
+         pause_histogram_percentile(pauses, 50) / 1e3,
+         pause_histogram_percentile(pauses, 99) / 1e3,
+         pauses->max_ns / 1e3,
+         pauses->total_ns / 1e6);
+  printf("G_%d phases (ms):          roots %.3f | cards %.3f | scan %.3f | flip %.3f\n",
+         g->number,
+         g->phase_ns[PHASE_ROOTS] / 1e6,
+         g->phase_ns[PHASE_CARDS] / 1e6,
+         g->phase_ns[PHASE_SCAN] / 1e6,
+         g->phase_ns[PHASE_FLIP] / 1e6);
+  if (g->phase_ns[PHASE_COMPACT] > 0) {
+    printf("G_%d compaction (ms):      mark %.3f | compact %.3f\n",
+           g->number,
+           g->phase_ns[PHASE_MARK] / 1e6,
+           g->phase_ns[PHASE_COMPACT] / 1e6);
+  }
+  if (g->from->free_lists != NULL) {
+    const struct free_lists* lists = g->from->free_lists;
+    printf("G_%d mark-sweep (ms):      mark %.3f | sweep %.3f | %" PRIu64 " bytes reused from free cells, %zu free\n",
+           g->number,
+           g->phase_ns[PHASE_MARK] / 1e6,
+           g->phase_ns[PHASE_SWEEP] / 1e6,
+           lists->reused_bytes,
+           lists->free_bytes);
+  }
+  if (g == g_old && gc_pool.collections > 0) {
+    printf("G_%d parallel copying:     %d threads | %" PRIu64 " collections | %" PRIu64 " objects stolen\n",
+           g->number,
+           gc_pool.count,
+           gc_pool.collections,
+           gc_pool.steals);
+  }
+  if (g == g_old && incremental.cycles > 0) {
+    printf("G_%d incremental:          quantum %zu bytes | %" PRIu64 " cycles | %" PRIu64 " steps | %" PRIu64 " barrier copies | %" PRIu64 " forced\n",
+           g->number,
+           config.incremental_quantum,
+           incremental.cycles,
+           incremental.steps,
+           incremental.barrier_copies,
+           incremental.forced);
+  }
+  printf("G_%d survival:             %" PRIu64 " of %" PRIu64 " collected bytes (%.2f%%), %" PRIu64 " bytes per collection\n",
+         g->number,
+         g->survived_bytes,
+         g->collected_bytes,
+         g->collected_bytes == 0 ? 0.0 : 100.0 * g->survived_bytes / g->collected_bytes,
+         g->collect_count == 0 ? 0 : g->survived_bytes / g->collect_count);
+}
+
+void print_age_stats() {
+  printf("G_0 survival by age:      ");
+  for (int age = 0; age < config.tenure_age; age++) {
+    // доля от оставленных в пространстве выживших с этим возрастом показывает, сколько из них еще умирает
+    const uint64_t kept = age_stats.kept_bytes[age];
+    printf("%sage %d: %" PRIu64 " bytes", age == 0 ? "" : " | ", age, age_stats.survived_bytes[age]);
+    if (kept > 0) {
+      printf(" (%.2f%%)", 100.0 * age_stats.survived_bytes[age] / kept);
+    }
+  }
+  printf("\n");
+  printf("G_0 tenuring:             age %d | survivor space %zu bytes | tenured %" PRIu64 " bytes | overflow %" PRIu64 " bytes\n",
+         config.tenure_age, config.survivor_size, age_stats.tenured_bytes, age_stats.overflow_bytes);
+}
+
+void gc_collect_stat_update() {
+  total_gc_collect += 1;
+}
+
+void residency_stat_update() {
+  uint64_t bytes = 0, objects = 0;
+  for (int i = 0; i < generation_count; i++) {
+    bytes += space_used(generations[i]->from);
+    objects += generations[i]->from->objects;
+    if (generations[i]->survivor_from != NULL) {
+      bytes += space_used(generations[i]->survivor_from);
+      objects += generations[i]->survivor_from->objects;
+    }
+  }
+
+  if (bytes > max_residency_bytes) max_residency_bytes = bytes;
+  if (objects > max_residency_objects) max_residency_objects = objects;
+}
+
+uint64_t peak_rss_bytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+  return (uint64_t) usage.ru_maxrss * 1024; // ru_maxrss в килобайтах
+}
+
+/** Значение статистики для экспорта */
+struct stat_value {
+  char name[48];
+  bool is_real;
+  uint64_t value;
+  double real;
+};
+
+#define MAX_STAT_VALUES 200
+
+static void add_stat(struct stat_value* values, int* count, const char* name, const uint64_t value) {
+  struct stat_value* v = &values[(*count)++];
+  snprintf(v->name, sizeof(v->name), "%s", name);
+  v->is_real = false;
+  v->value = value;
+}
+
+static void add_real_stat(struct stat_value* values, int* count, const char* name, const double real) {
+  struct stat_value* v = &values[(*count)++];
+  snprintf(v->name, sizeof(v->name), "%s", name);
+  v->is_real = true;
+  v->real = real;
+}
+
+void export_gc_stats() {
+  const char* path = getenv("STELLA_GC_STATS_FILE");
+  if (path == NULL || *path == '\0' || g0 == NULL) return;
+
+  const char* format = getenv("STELLA_GC_STATS_FORMAT");
+  if (format == NULL) {
+    const size_t length = strlen(path);
+    format = length >= 4 && strcmp(path + length - 4, ".csv") == 0 ? "csv" : "json";
+  }
+
+  sync_heap();
+  alloc_stat_update();
+
+  struct stat_value values[MAX_STAT_VALUES];
+  int count = 0;
+  add_stat(values, &count, "total_requested_bytes", total_requested_bytes);
+  add_stat(values, &count, "total_allocated_bytes", total_allocated_bytes);
+  add_stat(values, &count, "total_allocated_objects", total_allocated_objects);
+  add_stat(values, &count, "max_residency_bytes", max_residency_bytes);
+  add_stat(values, &count, "max_residency_objects", max_residency_objects);
+  add_stat(values, &count, "peak_rss_bytes", peak_rss_bytes());
+  add_stat(values, &count, "released_bytes", total_released_bytes);
+  add_stat(values, &count, "total_reads", total_reads);
+  add_stat(values, &count, "total_writes", total_writes);
+  add_stat(values, &count, "max_roots", gc_roots_max_size);
+  add_stat(values, &count, "gc_count", total_gc_collect);
+  add_stat(values, &count, "gc_time_ns", total_gc_time_ns);
+  add_stat(values, &count, "wall_time_ns", now_ns() - gc_start_time_ns);
+  add_stat(values, &count, "generations", generation_count);
+  add_stat(values, &count, "gc_threads", config.gc_threads);
+  add_stat(values, &count, "parallel_collections", gc_pool.collections);
+  add_stat(values, &count, "parallel_steals", gc_pool.steals);
+  add_stat(values, &count, "incremental_quantum", config.incremental_quantum);
+  add_stat(values, &count, "incremental_cycles", incremental.cycles);
+  add_stat(values, &count, "incremental_steps", incremental.steps);
+  add_stat(values, &count, "incremental_barrier_copies", incremental.barrier_copies);
+  add_stat(values, &count, "incremental_forced", incremental.forced);
+  add_stat(values, &count, "pause_count", gc_pauses.count);
+  add_stat(values, &count, "pause_p50_ns", pause_histogram_percentile(&gc_pauses, 50));
+  add_stat(values, &count, "pause_p99_ns", pause_histogram_percentile(&gc_pauses, 99));
+  add_stat(values, &count, "pause_max_ns", gc_pauses.max_ns);
+  for (int exponent = PAUSE_HISTOGRAM_MIN_EXPONENT; exponent <= PAUSE_HISTOGRAM_MAX_EXPONENT; exponent++) {
+    char name[48];
+    snprintf(name, sizeof(name), "pause_log2_ns_%d", exponent);
+    add_stat(values, &count, name, pause_histogram_bin(&gc_pauses, exponent));
+  }
+
+  for (int i = 0; i < generation_count; i++) {
+    const struct generation* g = generations[i];
+    char name[48];
+#define ADD_GEN_STAT(suffix, value) (snprintf(name, sizeof(name), "g%d_%s", g->number, suffix), add_stat(values, &count, name, value))
+    ADD_GEN_STAT("collections", g->collect_count);
+    ADD_GEN_STAT("collected_bytes", g->collected_bytes);
+    ADD_GEN_STAT("survived_bytes", g->survived_bytes);
+    ADD_GEN_STAT("survived_bytes_per_collection", g->collect_count == 0 ? 0 : g->survived_bytes / g->collect_count);
+    ADD_GEN_STAT("pause_min_ns", g->pauses.min_ns);
+    ADD_GEN_STAT("pause_p50_ns", pause_histogram_percentile(&g->pauses, 50));
+    ADD_GEN_STAT("pause_p99_ns", pause_histogram_percentile(&g->pauses, 99));
+    ADD_GEN_STAT("pause_max_ns", g->pauses.max_ns);
+    ADD_GEN_STAT("pause_total_ns", g->pauses.total_ns);
+#undef ADD_GEN_STAT
+    snprintf(name, sizeof(name), "g%d_survival_rate", g->number);
+    add_real_stat(values, &count, name, g->collected_bytes == 0 ? 0.0 : (double) g->survived_bytes / g->collected_bytes);
+  }
+  add_stat(values, &count, "nursery_size", config.nursery_size);
+  add_stat(values, &count, "nursery_min_size", nursery_policy.min_size);
+  add_stat(values, &count, "nursery_max_size", nursery_policy.max_size);
+  add_stat(values, &count, "nursery_resizes", nursery_policy.resizes);
+  add_stat(values, &count, "survivor_size", config.survivor_size);
+  add_stat(values, &count, "tenure_age", config.tenure_age);
+  add_stat(values, &count, "tenured_bytes", age_stats.tenured_bytes);
+  add_stat(values, &count, "overflow_bytes", age_stats.overflow_bytes);
+  for (int age = 0; age < config.tenure_age; age++) {
+    char name[48];
+    snprintf(name, sizeof(name), "age%d_survived_bytes", age);
+    add_stat(values, &count, name, age_stats.survived_bytes[age]);
+  }
+
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Can not write GC statistics to %s\n", path);
+    return;
+  }
+
+  if (strcmp(format, "csv") == 0) {
+    for (int i = 0; i < count; i++) {
+      fprintf(file, "%s%s", values[i].name, i < count - 1 ? "," : "\n");
+    }
+    for (int i = 0; i < count; i++) {
+      if (values[i].is_real) {
+        fprintf(file, "%.6f", values[i].real);
+      } else {
+        fprintf(file, "%" PRIu64, values[i].value);
+      }
+      fprintf(file, "%s", i < count - 1 ? "," : "\n");
+    }
+  } else {
+    fprintf(file, "{\n");
+    for (int i = 0; i < count; i++) {
+      if (values[i].is_real) {
+        fprintf(file, "  \"%s\": %.6f", values[i].name, values[i].real);
+      } else {
+        fprintf(file, "  \"%s\": %" PRIu64, values[i].name, values[i].value);
+      }
+      fprintf(file, "%s\n", i < count - 1 ? "," : "");
+    }
+    fprintf(file, "}\n");
+  }
+
+  fclose(file);
+}
+
+bool is_in_heap(const void* ptr, const void* heap, const size_t heap_size) {
+  return ptr >= heap && ptr < heap + heap_size;
+}
+
+int generation_of(const void* ptr) {
+  for (int i = 0; i < generation_count; i++) {
+    const struct generation* g = generations[i];
+    if (is_in_place(g->from, ptr)) return i;
+    if (g->survivor_from != NULL && (is_in_place(g->survivor_from, ptr) || is_in_place(g->survivor_to, ptr))) return i;
+  }
+
+  return -1;
+}
+
+void exit_with_out_memory_error() {
+  printf("Out of memory!");
+  exit(137);
+}
+
+void exit_with_roots_error(const char* message) {
+  printf("%s", message);
+  exit(1);
+}
+
+void push_root_chunk() {
+  if (gc_roots != NULL && gc_roots->next != NULL) {
+    gc_roots = gc_roots->next;
+    gc_roots_top = 0;
+    return;
+  }
+
+  const int base = gc_roots == NULL ? 0 : gc_roots->base + ROOT_CHUNK_SIZE;
+  if (base + ROOT_CHUNK_SIZE > MAX_GC_ROOTS) {
+    exit_with_roots_error("GC roots stack overflow!");
+  }
+
+  struct root_chunk *chunk = malloc(sizeof(struct root_chunk));
+  if (chunk == NULL) {
+    exit_with_out_memory_error();
+  }
+
+  chunk->prev = gc_roots;
+  chunk->next = NULL;
+  chunk->base = base;
+  if (gc_roots != NULL) {
+    gc_roots->next = chunk;
+  }
+
+  gc_roots = chunk;
+  gc_roots_top = 0;
+}
+
+void pop_root_chunk() {
+  if (gc_roots == NULL || gc_roots->prev == NULL) {
+    exit_with_roots_error("GC roots stack underflow!");
+  }
+
+  // После выхода из глубокой рекурсии в запасе остается только один кусок
+  free(gc_roots->next);
+  gc_roots->next = NULL;
+
+  gc_roots = gc_roots->prev;
+  gc_roots_top = ROOT_CHUNK_SIZE;
+}
+
+void for_each_root(void (*visit)(void** slot, void* context), void* context) {
+  for (const struct root_chunk *chunk = gc_roots; chunk != NULL; chunk = chunk->prev) {
+    const int top = chunk == gc_roots ? gc_roots_top : ROOT_CHUNK_SIZE;
+    for (int i = top - 1; i >= 0; i--) {
+      const struct root_frame *frame = &chunk->frames[i];
+      for (int j = 0; j < frame->count; j++) {
+        visit(&frame->slots[j], context);
+      }
+    }
+  }
+}
+
+// gc_object
+size_t get_stella_object_size(const stella_object *obj) {
+  const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->object_header);
+  // в куче у объекта всегда есть место хотя бы под одно поле - туда пишется адрес при переносе
+  return sizeof(stella_object) + (field_count > 0 ? field_count : 1) * sizeof(stella_ref);
+}
+
+size_t get_gc_object_size(const struct gc_object *obj) {
+  return GC_OBJECT_HEADER_SIZE + get_stella_object_size(&obj->stella_object);
+}
+
+struct gc_object* get_gc_object(void* st_ptr) {
+  return st_ptr - GC_OBJECT_HEADER_SIZE;
+}
+
+stella_object* get_stella_object(struct gc_object* gc_ptr) {
+  return &gc_ptr->stella_object;
+}
+
+bool is_forwarded(const struct gc_object* obj) {
+  return obj->stella_object.object_header & FORWARDED;
+}
+
+struct gc_object* get_forwarded(const struct gc_object* obj) {
+  return get_gc_object(STELLA_REF_DECODE(obj->stella_object.object_fields[0]));
+}
+
+void set_forwarded(struct gc_object* obj, struct gc_object* to) {
+  obj->stella_object.object_header |= FORWARDED;
+  obj->stella_object.object_fields[0] = STELLA_REF_ENCODE(get_stella_object(to));
+}
+
+int get_age(const struct gc_object* obj) {
+  return (obj->stella_object.object_header & AGE_MASK) >> AGE_SHIFT;
+}
+
+void set_age(struct gc_object* obj, const int age) {
+  obj->stella_object.object_header = (obj->stella_object.object_header & ~AGE_MASK) | (age << AGE_SHIFT);
+}
+
+// space
+bool is_in_place(const struct space* space, const void* ptr) {
+  return is_in_heap(ptr, space->heap, space->size);
+}
+
+size_t space_used(const struct space* space) {
+  // у места со списками свободных ячеек до next лежат и мертвые объекты, и свободные ячейки
+  if (space->free_lists != NULL) return space->free_lists->used;
+
+  return space->next - space->heap;
+}
+
+size_t space_free(const struct space* space) {
+  return space->size - space_used(space);
+}
+
+struct space* new_space() {
+  struct space* space = calloc(1, sizeof(struct space));
+  if (space == NULL) {
+    exit_with_out_memory_error();
+  }
+
+  return space;
+}
+
+void alloc_space(struct space* space, const int gen, const size_t size) {
+  init_space(space, gen, alloc_heap(size, gen), size);
+}
+
+void init_space(struct space* space, const int gen, void* heap, const size_t size) {
+  space->gen = gen;
+  space->size = size;
+  space->heap = heap;
+  space->next = space->heap;
+
+  // В поколение 0 нет ссылок из более молодых поколений, таблица карт ему не нужна
+  space->cards = NULL;
+  space->card_start = NULL;
+  space->dirty = NULL;
+  if (gen > 0) {
+    space->cards = malloc(space_card_count(space));
+    space->card_start = malloc(space_card_count(space) * sizeof(uint16_t));
+    space->dirty = malloc(space_card_count(space) * sizeof(uint32_t));
+  }
+
+  if (space->heap == NULL || (gen > 0 && (space->cards == NULL || space->card_start == NULL || space->dirty == NULL))) {
+    exit_with_out_memory_error();
+  }
+
+  reset_space(space);
+}
+
+void alloc_young_spaces() {
+  size_t size = 2 * config.survivor_size;
+  size_t middle_size = config.nursery_size;
+  for (int i = 1; i < generation_count - 1; i++) {
+    middle_size = align_size(middle_size * config.generation_ratio);
+    size += middle_size;
+  }
+
+  void* heap = alloc_heap(size, 1);
+  if (heap == NULL) {
+    exit_with_out_memory_error();
+  }
+
+  g0->survivor_from = new_space();
+  g0->survivor_to = new_space();
+  init_space(g0->survivor_from, 0, heap, config.survivor_size);
+  init_space(g0->survivor_to, 0, heap + config.survivor_size, config.survivor_size);
+  heap += 2 * config.survivor_size;
+
+  middle_size = config.nursery_size;
+  for (int i = 1; i < generation_count - 1; i++) {
+    middle_size = align_size(middle_size * config.generation_ratio);
+    generations[i]->from = new_space();
+    init_space(generations[i]->from, i, heap, middle_size);
+    heap += middle_size;
+  }
+}
+
+size_t align_size(const size_t size) {
+  return (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+}
+
+void resize_space(struct space* space, const size_t size) {
+  free_heap(space->heap, space->size);
+  free(space->cards);
+  free(space->card_start);
+  free(space->dirty);
+  alloc_space(space, space->gen, size);
+}
+
+void* alloc_heap(const size_t size, const int gen) {
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  void* hint = NULL;
+#ifdef STELLA_COMPRESSED_REFS
+#ifdef MAP_32BIT
+  flags |= MAP_32BIT;
+#else
+  hint = (void*) (1UL << 30);
+#endif
+#endif
+
+  void* heap = mmap(hint, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (heap == MAP_FAILED) return NULL;
+#ifdef STELLA_COMPRESSED_REFS
+  if ((uintptr_t)heap + size > UINT32_MAX) {
+    munmap(heap, size);
+    return NULL;
+  }
+#endif
+
+  if (gen == 0) {
+#ifdef MADV_HUGEPAGE
+    // поколение 0 просматривается целиком на каждом круге выделения - большие страницы экономят TLB
+    if (config.huge_pages) {
+      madvise(heap, size, MADV_HUGEPAGE);
+    }
+#endif
+    // страницы отображения уже обнулены, запись нужна только чтобы сразу получить их от ОС
+    if (config.prefault) {
+      memset(heap, 0, size);
+    }
+  }
+
+  return heap;
+}
+
+void free_heap(void* heap, const size_t size) {
+  munmap(heap, size);
+}
+
+int release_advice() {
+  switch (config.release) {
+    case GC_RELEASE_DONTNEED: return MADV_DONTNEED;
+#ifdef MADV_FREE
+    case GC_RELEASE_FREE: return MADV_FREE;
+#else
+    case GC_RELEASE_FREE: return MADV_DONTNEED;
+#endif
+    default: return -1;
+  }
+}
+
+void release_space(struct space* space) {
+  const int advice = release_advice();
+  if (advice < 0) return;
+
+  if (madvise(space->heap, space->size, advice) == 0) {
+    total_released_bytes += space->size;
+  }
+}
+
+void release_range(void* start, void* end) {
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  void* first = (void*) (((uintptr_t) start + page - 1) & ~(page - 1));
+  void* last = (void*) ((uintptr_t) end & ~(page - 1));
+  const int advice = release_advice();
+  if (first >= last || advice < 0) return;
+
+  if (madvise(first, last - first, advice) == 0) {
+    total_released_bytes += last - first;
+  }
+}
+
+void extend_space(struct space* space, const size_t size) {
+  const size_t old_count = space_card_count(space);
+  const size_t old_marks = space->free_lists != NULL ? mark_bitmap_size(space) : 0;
+  space->size = size;
+  const size_t count = space_card_count(space);
+
+  space->cards = realloc(space->cards, count);
+  space->card_start = realloc(space->card_start, count * sizeof(uint16_t));
+  space->dirty = realloc(space->dirty, count * sizeof(uint32_t));
+  if (space->cards == NULL || space->card_start == NULL || space->dirty == NULL) {
+    exit_with_out_memory_error();
+  }
+
+  memset(space->cards + old_count, 0, count - old_count);
+  memset(space->card_start + old_count, 0xFF, (count - old_count) * sizeof(uint16_t));
+
+  if (space->free_lists != NULL) {
+    struct free_lists* lists = space->free_lists;
+    lists->marks = realloc(lists->marks, mark_bitmap_size(space));
+    if (lists->marks == NULL) {
+      exit_with_out_memory_error();
+    }
+    memset(lists->marks + old_marks, 0, mark_bitmap_size(space) - old_marks);
+  }
+}
+
+void reset_space(struct space* space) {
+  const size_t used = space_used(space);
+  space->next = space->heap;
+  space->objects = 0;
+
+  if (space == g0->from) {
+    // Поля объектов инициализируются уже после выделения, а сборка может начаться раньше,
+    // поэтому освобожденная память не должна содержать старых указателей.
+    // Память дальше next не тронута с прошлого обнуления (или отображения)
+    memset(space->heap, 0, used);
+    // все выделенное до сборки уже учтено в статистике
+    nursery_counted = space->heap;
+  } else if (space->cards != NULL) {
+    // в пространство выживших объекты только копируются целиком, обнулять его не нужно
+    memset(space->cards, 0, space_card_count(space));
+    space->dirty_count = 0;
+    memset(space->card_start, 0xFF, space_card_count(space) * sizeof(uint16_t));
+  }
+}
+
+size_t space_card_count(const struct space* space) {
+  return (space->size + CARD_SIZE - 1) >> CARD_SHIFT;
+}
+
+void scan_dirty_cards(struct generation* g, struct space* space) {
+  // карты, оставшиеся помеченными, переписываются в начало того же списка
+  size_t kept = 0;
+  for (size_t i = 0; i < space->dirty_count; i++) {
+    const size_t card = space->dirty[i];
+    space->cards[card] = 0;
+    if (space->card_start[card] == NO_OBJECT_START) continue;
+
+    bool young = false;
+    void* card_end = space->heap + ((card + 1) << CARD_SHIFT);
+    void* end = card_end < space->next ? card_end : space->next;
+    for (void *ptr = space->heap + (card << CARD_SHIFT) + space->card_start[card]; ptr < end; ptr += get_gc_object_size(ptr)) {
+      young |= forward_fields(g, ptr, space->gen);
+    }
+
+    if (young) {
+      space->cards[card] = 1;
+      space->dirty[kept++] = card;
+    }
+  }
+
+  space->dirty_count = kept;
+}
+
+void gc_remember_middle(void *object, const void *contents) {
+  const int gen = generation_of(object);
+  const int contents_gen = generation_of(contents);
+  if (gen > 0 && contents_gen >= 0 && contents_gen < gen) {
+    mark_card(generations[gen]->from, get_gc_object(object));
+  }
+}
+
+void mark_card(struct space* space, const void* ptr) {
+  const size_t card = (ptr - space->heap) >> CARD_SHIFT;
+  if (space->cards[card] == 0) {
+    space->cards[card] = 1;
+    space->dirty[space->dirty_count++] = card;
+  }
+}
+
+bool has_enough_space(const struct space* space, const size_t requested_size) {
+  return space->next + requested_size <= space->heap + space->size;
+}
+
+struct gc_object* alloc_in_space(struct space* space, const size_t size_in_bytes) {
+  const size_t size = size_in_bytes + GC_OBJECT_HEADER_SIZE;
+  if (space->free_lists != NULL) {
+    return alloc_cell(space, size);
+  }
+
+  if (has_enough_space(space, size)) {
+    struct gc_object *result = space->next;
+    result->stella_object.object_header = 0;
+    space->next += size;
+    space->objects++;
+    note_object_start(space, result);
+
+    return result;
+  }
+
+  return NULL;
+}
+
+void note_object_start(struct space* space, const struct gc_object* obj) {
+  if (space->card_start == NULL) return;
+
+  // объекты обычно выделяются по возрастанию адресов, но при делении свободной ячейки начало появляется внутри карты
+  const size_t offset = (const void*) obj - space->heap;
+  uint16_t *start = &space->card_start[offset >> CARD_SHIFT];
+  if (*start == NO_OBJECT_START || *start > (offset & (CARD_SIZE - 1))) {
+    *start = offset & (CARD_SIZE - 1);
+  }
+}
+
+void print_space(const struct space* space) {
+  printf("OBJECTS:\n");
+  for (void *start = space->heap; start < space->next; start += get_gc_object_size(start)) {
+      const struct gc_object *gc_ptr = start;
+      const int tag = STELLA_OBJECT_HEADER_TAG(gc_ptr->stella_object.object_header);
+      printf("\tGC ADDRESS: %-15p | ST ADDRESS: %-15p | MOVED: %-15p | TAG: %-2d | FIELDS: ",
+             gc_ptr,
+             &gc_ptr->stella_object,
+             is_forwarded(gc_ptr) ? get_forwarded(gc_ptr) : NULL,
+             tag);
+
+      const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(gc_ptr->stella_object.object_header);
+      for (int i = 0; i < field_count; i++) {
+          printf("%-15p", STELLA_REF_DECODE(gc_ptr->stella_object.object_fields[i]));
+          if (i < field_count - 1) {
+              printf(" ");
+          }
+      }
+
+      printf("\n");
+  }
+
+  // Кол-во выделенной памяти
+  printf("BOUNDARIES  | FROM: %-15p | TO: %-15p | TOTAL: %zu bytes\n",
+         space->heap,
+         space->heap + space->size,
+         space->size);
+  printf("FREE MEMORY | FROM: %-15p | TO: %-15p | TOTAL: %ld bytes\n",
+         space->next,
+         space->heap + space->size,
+         space->heap + space->size - space->next);
+
+  if (space->cards != NULL) {
+    printf("CARDS       | TOTAL: %zu | DIRTY: %zu\n", space_card_count(space), space->dirty_count);
+  }
+
+}
+
+// generation
+void print_state(const struct generation* g) {
+  print_separator();
+  printf("G_%d STATE\n", g->number);
+  print_separator();
+
+  printf("COLLECT COUNT %" PRIu64 "\n", g->collect_count);
+  print_space(g->from);
+
+  if (g->to != NULL && g->to->gen == g->from->gen) {
+    printf("TO SPACE\n");
+    print_space(g->to);
+  }
+
+  if (g->survivor_from != NULL) {
+    printf("SURVIVOR SPACE\n");
+    print_space(g->survivor_from);
+    printf("SURVIVOR SCAN: %-15p | NEXT: %-15p | LIMIT: %-15p\n",
+           g->survivor_scan, g->survivor_to->next, g->survivor_to->heap + g->survivor_to->size);
+  }
+
+  if (g->to != NULL) {
+    printf("SCAN: %-15p | NEXT: %-15p | LIMIT: %-15p\n", g->scan, g->to->next, g->to->heap + g->to->size);
+  }
+
+  print_separator();
+}
+
+void* try_alloc(struct generation* g, const size_t size_in_bytes) {
+  void* allocated = alloc_in_space(g->from, size_in_bytes);
+  if (allocated == NULL) {
+    return NULL;
+  }
+
+  return allocated + GC_OBJECT_HEADER_SIZE;
+}
+
+bool chase(struct generation* g, struct gc_object *p) {
+  do {
+    const size_t size = get_stella_object_size(&p->stella_object);
+    struct space* to = destination(g, p, size);
+    struct gc_object *q = alloc_in_space(to, size);
+    if (q == NULL) {
+      return false;
+    }
+
+    const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(p->stella_object.object_header);
+    const int pointer_count = STELLA_OBJECT_HEADER_POINTER_COUNT(p->stella_object.object_header);
+    void *r = NULL;
+
+    q->stella_object.object_header = p->stella_object.object_header;
+    if (g->survivor_to != NULL) {
+      // малая сборка: объект пережил еще одну сборку
+      const int age = get_age(p);
+      age_stats.survived_bytes[age] += size;
+      if (to == g->survivor_to) {
+        age_stats.kept_bytes[age + 1] += size;
+      } else if (age + 1 >= config.tenure_age) {
+        age_stats.tenured_bytes += size;
+      } else {
+        age_stats.overflow_bytes += size;
+      }
+      set_age(q, age + 1);
+    }
+    for (int i = 0; i < field_count; i++) {
+      q->stella_object.object_fields[i] = p->stella_object.object_fields[i];
+
+      if (i < pointer_count && is_collected(g, STELLA_REF_DECODE(q->stella_object.object_fields[i]))) {
+        struct gc_object *potentially_forwarded = get_gc_object(STELLA_REF_DECODE(q->stella_object.object_fields[i]));
+
+        if (!is_forwarded(potentially_forwarded)) {
+          r = potentially_forwarded;
+        }
+      }
+    }
+
+    tag_stat_update(g, p, to);
+    set_forwarded(p, q);
+    p = r;
+  } while (p != NULL);
+
+  return true;
+}
+
+struct space* destination(const struct generation* g, const struct gc_object* p, const size_t size) {
+  // не поместившиеся в пространство выживших повышаются раньше срока
+  if (g->survivor_to == NULL || tenure_all || get_age(p) + 1 >= config.tenure_age || !has_enough_space(g->survivor_to, size)) {
+    return g->to;
+  }
+
+  return g->survivor_to;
+}
+
+bool is_collected(const struct generation* g, const void* ptr) {
+  for (int i = g->number; i >= 0; i--) {
+    if (is_in_place(generations[i]->from, ptr)) return true;
+    if (generations[i]->survivor_from != NULL && is_in_place(generations[i]->survivor_from, ptr)) return true;
+  }
+
+  return false;
+}
+
+void tag_stat_update(const struct generation* g, const struct gc_object* p, const struct space* to) {
+#ifdef STELLA_RUNTIME_STATS
+  stella_tag_stats* stats = &tag_stats[STELLA_OBJECT_HEADER_TAG(p->stella_object.object_header)];
+  for (int i = 0; i <= g->number; i++) {
+    const struct generation* source = generations[i];
+    const bool in_survivors = source->survivor_from != NULL && is_in_place(source->survivor_from, p);
+    if (!in_survivors && !is_in_place(source->from, p)) continue;
+    // объект впервые переживает сборку, только покидая место выделения поколения 0
+    // счетчики общие для потоков параллельной сборки
+    if (i == 0 && !in_survivors) __atomic_add_fetch(&stats->survived_objects, 1, __ATOMIC_RELAXED);
+    if (i < to->gen) __atomic_add_fetch(&stats->promoted_objects, 1, __ATOMIC_RELAXED);
+    return;
+  }
+#endif
+}
+
+void* forward(struct generation* g, void* p) {
+  if (!is_collected(g, p)) {
+    return p;
+  }
+
+  struct gc_object* gc_object = get_gc_object(p);
+
+  if (is_forwarded(gc_object)) {
+    return get_stella_object(get_forwarded(gc_object));
+  }
+
+  // gc_collect заранее освобождает место под все переносимые объекты,
+  // поэтому нехватка памяти здесь означает достижение максимального размера кучи
+  if (!chase(g, gc_object)) {
+    exit_with_out_memory_error();
+  }
+  return get_stella_object(get_forwarded(gc_object));
+}
+
+bool forward_fields(struct generation* g, struct gc_object* obj, const int gen) {
+  bool young = false;
+  const int pointer_count = STELLA_OBJECT_HEADER_POINTER_COUNT(obj->stella_object.object_header);
+  for (int i = 0; i < pointer_count; i++) {
+    void* field = forward(g, STELLA_REF_DECODE(obj->stella_object.object_fields[i]));
+    obj->stella_object.object_fields[i] = STELLA_REF_ENCODE(field);
+    young |= is_younger(g, field, gen);
+  }
+
+  return young;
+}
+
+bool is_younger(const struct generation* g, const void* ptr, const int gen) {
+  // собранные поколения пусты, кроме пространства выживших
+  if (g->survivor_to != NULL && is_in_place(g->survivor_to, ptr)) return true;
+  for (int i = g->number + 1; i < gen; i++) {
+    if (is_in_place(generations[i]->from, ptr)) return true;
+  }
+
+  return false;
+}
+
+void grow_generation(struct generation* g, const size_t live) {
+  // Растим, пока после сборки не останется места под одно заполненное поколение 0 и резерв под его перенос
+  const size_t size = reserved_size(g, live);
+
+  // сжимаемое на месте поколение растет внутри заранее отображенного куска
+  if (g->to == NULL) {
+    if (size > g->from->size) {
+      extend_space(g->from, size);
+    }
+    return;
+  }
+
+  if (size > g->to->size) {
+    resize_space(g->to, size);
+  }
+
+  // Резерва не осталось уже сейчас - сразу переносим выживших в увеличенное полупространство
+  if (space_used(g->from) + younger_capacity(g->number) > g->from->size && g->to->size > g->from->size) {
+    collect(g);
+  }
+
+  if (g->to->size < g->from->size) {
+    resize_space(g->to, g->from->size);
+  }
+}
+
+size_t reserved_size(const struct generation* g, const size_t live) {
+  size_t size = g->from->size;
+  while (size < live + 2 * younger_capacity(g->number) && size < config.max_old_size) {
+    size_t grown = size * config.growth_factor;
+    if (grown <= size) grown = size + 1;
+    size = grown < config.max_old_size ? grown : config.max_old_size;
+  }
+
+  return size;
+}
+
+static void forward_root_slot(void** slot, void* g) {
+  *slot = forward(g, *slot);
+}
+
+static void parallel_forward_root_slot(void** slot, void* g) {
+  *slot = parallel_forward_root(g, *slot);
+}
+
+void collect(struct generation* g) {
+#ifdef DEBUG_LOGS
+  print_separator();
+  printf("COLLECTING G_%d - COLLECTING NUMBER %" PRIu64 "\n", g->number, g->collect_count);
+  print_gc_state();
+#endif
+
+  const uint64_t start = now_ns();
+  uint64_t phase_start = start, phase_end;
+
+  for (int i = 0; i <= g->number; i++) {
+    g->collected_bytes += space_used(generations[i]->from);
+    if (generations[i]->survivor_from != NULL) {
+      g->collected_bytes += space_used(generations[i]->survivor_from);
+    }
+  }
+
+  const size_t to_used = space_used(g->to);
+  g->scan = g->to->next;
+  if (g->survivor_to != NULL) {
+    g->survivor_scan = g->survivor_to->next;
+  }
+
+  // при параллельной сборке корни переносит мутатор без chase, а достижимое из них сканируют потоки пула
+  const bool parallel = is_parallel(g);
+  if (parallel) {
+    start_workers(g);
+  }
+
+  for_each_root(parallel ? parallel_forward_root_slot : forward_root_slot, g);
+
+  phase_end = now_ns();
+  g->phase_ns[PHASE_ROOTS] += phase_end - phase_start;
+  phase_start = phase_end;
+
+#ifdef DEBUG_LOGS
+  print_separator();
+  printf("FORWARD ALL ROOTS\n");
+  print_gc_state();
+#endif
+
+  // objects of older generations with links to collected generation
+  for (int i = g->number + 1; i < generation_count; i++) {
+    scan_dirty_cards(g, generations[i]->from);
+  }
+
+  phase_end = now_ns();
+  g->phase_ns[PHASE_CARDS] += phase_end - phase_start;
+  phase_start = phase_end;
+
+#ifdef DEBUG_LOGS
+  print_separator();
+  printf("FORWARD FIELDS OF OBJECTS FROM DIRTY CARDS\n");
+  print_gc_state();
+#endif
+
+  // серые объекты параллельной сборки лежат в очередях потоков, а не между scan и next
+  if (parallel) {
+    parallel_scan(g);
+    g->scan = g->to->next;
+  }
+
+  // перенесенные объекты лежат в двух местах (to и пространство выживших), сканируем оба, пока не догоним next
+  // (в неперемещающее старшее поколение объекты ложатся не подряд, их список ведет alloc_cell)
+  while (true) {
+    if (g->to->free_lists == NULL && g->scan < g->to->next) {
+      struct gc_object *obj = g->scan;
+      // повышенный объект, ссылающийся на оставшегося в поколении 0, запоминается в таблице карт
+      if (forward_fields(g, obj, g->to->gen) && g->to->cards != NULL) {
+        mark_card(g->to, obj);
+      }
+      g->scan += get_gc_object_size(obj);
+    } else if (promoted.size > 0) {
+      struct gc_object *obj = promoted.items[--promoted.size];
+      if (forward_fields(g, obj, g->to->gen)) {
+        mark_card(g->to, obj);
+      }
+    } else if (g->survivor_to != NULL && g->survivor_scan < g->survivor_to->next) {
+      struct gc_object *obj = g->survivor_scan;
+      forward_fields(g, obj, 0);
+      g->survivor_scan += get_gc_object_size(obj);
+    } else {
+      break;
+    }
+  }
+
+  phase_end = now_ns();
+  g->phase_ns[PHASE_SCAN] += phase_end - phase_start;
+  phase_start = phase_end;
+
+#ifdef DEBUG_LOGS
+  print_separator();
+  printf("SCAN TO NEXT\n");
+  print_gc_state();
+#endif
+
+  g->survived_bytes += space_used(g->to) - to_used;
+  if (g->survivor_to != NULL) {
+    g->survived_bytes += space_used(g->survivor_to);
+  }
+
+  if (g->from->gen == g->to->gen) { // copying gc
+    void *buff = g->from;
+    g->from = g->to;
+    g->to = buff;
+
+    reset_space(g->to);
+    release_space(g->to);
+
+    // более молодые поколения перенесены целиком (вместе с пространствами выживших)
+    for (int i = 0; i < g->number; i++) {
+      reset_space(generations[i]->from);
+      if (generations[i]->survivor_from != NULL) {
+        reset_space(generations[i]->survivor_from);
+      }
+    }
+
+    struct generation* past = generations[g->from->gen - 1];
+    past->to = g->from;
+  } else { // generations
+    // собранные поколения перенесены целиком, кроме оставленных в пространстве выживших этой сборки
+    for (int i = 0; i <= g->number; i++) {
+      struct generation* current = generations[i];
+      reset_space(current->from);
+      if (current->survivor_from == NULL) continue;
+
+      reset_space(current->survivor_from);
+      if (current == g) {
+        struct space* buff = current->survivor_from;
+        current->survivor_from = current->survivor_to;
+        current->survivor_to = buff;
+      }
+    }
+  }
+
+  phase_end = now_ns();
+  g->phase_ns[PHASE_FLIP] += phase_end - phase_start;
+
+#ifdef DEBUG_LOGS
+  print_separator();
+  printf("END OF COLLECTING\n");
+  print_gc_state();
+#endif
+}
+
+// mark-compact
+static void compact_root_slot(void** slot, void* space) {
+  *slot = compacted_address(space, *slot);
+}
+
+void compact_generation(struct generation* g) {
+  // Младшие поколения переносятся в старшее обычной сборкой (резерв под них в нем держится всегда),
+  // после чего живые объекты остаются только в старшем поколении
+  tenure_all = true;
+  collect(generations[g->number - 1]);
+  tenure_all = false;
+
+#ifdef DEBUG_LOGS
+  print_separator();
+  printf("COMPACTING G_%d - COLLECTING NUMBER %" PRIu64 "\n", g->number, g->collect_count);
+  print_gc_state();
+#endif
+
+  const uint64_t start = now_ns();
+  uint64_t phase_start = start, phase_end;
+
+  struct space* space = g->from;
+  void* const used_end = space->next;
+  g->collected_bytes += space_used(space);
+
+  size_t live_bytes = 0;
+  const size_t live = mark_roots(space, &live_bytes);
+
+  phase_end = now_ns();
+  g->phase_ns[PHASE_MARK] += phase_end - phase_start;
+  phase_start = phase_end;
+
+  // Новые адреса назначаются по порядку живых объектов и пишутся в их первое поле,
+  // а вытесненные первые поля в том же порядке сохраняются в отдельной таблице
+  stella_ref* displaced = malloc((live + 1) * sizeof(stella_ref));
+  if (displaced == NULL) {
+    exit_with_out_memory_error();
+  }
+
+  void* free_ptr = space->heap;
+  size_t k = 0;
+  for (void* ptr = space->heap; ptr < used_end; ptr += get_gc_object_size(ptr)) {
+    struct gc_object* obj = ptr;
+    if (!is_marked(space, obj)) continue;
+
+    displaced[k++] = obj->stella_object.object_fields[0];
+    obj->stella_object.object_fields[0] = STELLA_REF_ENCODE(get_stella_object(free_ptr));
+    free_ptr += get_gc_object_size(obj);
+  }
+
+  for_each_root(compact_root_slot, space);
+
+  k = 0;
+  for (void* ptr = space->heap; ptr < used_end; ptr += get_gc_object_size(ptr)) {
+    struct gc_object* obj = ptr;
+    if (!is_marked(space, obj)) continue;
+
+    const int pointer_count = STELLA_OBJECT_HEADER_POINTER_COUNT(obj->stella_object.object_header);
+    for (int i = 0; i < pointer_count; i++) {
+      stella_ref* field = i == 0 ? &displaced[k] : &obj->stella_object.object_fields[i];
+      *field = STELLA_REF_ENCODE(compacted_address(space, STELLA_REF_DECODE(*field)));
+    }
+    k++;
+  }
+
+  // Объекты сдвигаются только к началу места, поэтому еще не пройденные объекты не затираются.
+  // Ссылок в младшие поколения после сжатия нет, таблица карт строится заново
+  memset(space->cards, 0, space_card_count(space));
+  memset(space->card_start, 0xFF, space_card_count(space) * sizeof(uint16_t));
+  space->dirty_count = 0;
+
+  k = 0;
+  void* ptr = space->heap;
+  while (ptr < used_end) {
+    struct gc_object* obj = ptr;
+    const size_t size = get_gc_object_size(obj);
+    ptr += size;
+    if (!is_marked(space, obj)) continue;
+
+    struct gc_object* moved = get_gc_object(STELLA_REF_DECODE(obj->stella_object.object_fields[0]));
+    memmove(moved, obj, size);
+    moved->stella_object.object_fields[0] = displaced[k++];
+    moved->stella_object.object_header &= ~MARKED;
+    note_object_start(space, moved);
+  }
+  free(displaced);
+
+  space->next = free_ptr;
+  space->objects = live;
+  release_range(free_ptr, used_end);
+  g->survived_bytes += space_used(space);
+
+  phase_end = now_ns();
+  g->phase_ns[PHASE_COMPACT] += phase_end - phase_start;
+
+#ifdef DEBUG_LOGS
+  print_separator();
+  printf("END OF COMPACTING\n");
+  print_gc_state();
+#endif
+}
 
-  if (is_in_place(g->to, gc_object->moved_to)) {
-    return get_stella_object(gc_object->moved_to);
-  }
+/** Состояние пометки от корней (см. mark_roots) */
+struct root_marking {
+  struct space* space; /** Помечаемое место */
+  size_t marked; /** Кол-во помеченных объектов */
+  size_t* bytes; /** Объем помеченных объектов */
+};
 
-  bool chase_result = chase(g, gc_object);
-  if (!chase_result) {
-    if (g->to->gen == g->from->gen) {
-      exit_with_out_memory_error();
+static void mark_root_slot(void** slot, void* context) {
+  struct root_marking* marking = context;
+  marking->marked += mark_from(marking->space, *slot, marking->bytes);
+}
+
+size_t mark_roots(struct space* space, size_t* bytes) {
+  struct root_marking marking = { .space = space, .marked = 0, .bytes = bytes };
+  for_each_root(mark_root_slot, &marking);
+
+  return marking.marked;
+}
+
+size_t mark_from(struct space* space, void* ptr, size_t* bytes) {
+  size_t marked = 0;
+  mark_push(space, ptr, &marked, bytes);
+
+  while (mark_stack.size > 0) {
+    struct gc_object* obj = mark_stack.items[--mark_stack.size];
+    const int pointer_count = STELLA_OBJECT_HEADER_POINTER_COUNT(obj->stella_object.object_header);
+    for (int i = 0; i < pointer_count; i++) {
+      mark_push(space, STELLA_REF_DECODE(obj->stella_object.object_fields[i]), &marked, bytes);
     }
+  }
+
+  return marked;
+}
+
+void mark_push(struct space* space, void* ptr, size_t* marked, size_t* bytes) {
+  if (!is_in_place(space, ptr)) return;
+
+  struct gc_object* obj = get_gc_object(ptr);
+  if (is_marked(space, obj)) return;
+  set_marked(space, obj);
+  (*marked)++;
+  *bytes += get_gc_object_size(obj);
+
+  push_object(&mark_stack, obj);
+}
+
+bool is_marked(const struct space* space, const struct gc_object* obj) {
+  if (space->free_lists == NULL) return obj->stella_object.object_header & MARKED;
+
+  const size_t bit = ((const void*) obj - space->heap) / sizeof(stella_ref);
+  return space->free_lists->marks[bit >> 3] & (1 << (bit & 7));
+}
 
-    collect(generations[g->to->gen]);
+void set_marked(struct space* space, struct gc_object* obj) {
+  if (space->free_lists == NULL) {
+    obj->stella_object.object_header |= MARKED;
+    return;
+  }
+
+  const size_t bit = ((void*) obj - space->heap) / sizeof(stella_ref);
+  space->free_lists->marks[bit >> 3] |= 1 << (bit & 7);
+}
 
-    chase_result = chase(g, gc_object);
-    if (!chase_result) {
+void push_object(struct object_stack* stack, struct gc_object* obj) {
+  if (stack->size == stack->capacity) {
+    stack->capacity = stack->capacity == 0 ? ROOT_CHUNK_SIZE : 2 * stack->capacity;
+    stack->items = realloc(stack->items, stack->capacity * sizeof(struct gc_object*));
+    if (stack->items == NULL) {
       exit_with_out_memory_error();
     }
   }
-  return get_stella_object(gc_object->moved_to);
+  stack->items[stack->size++] = obj;
 }
 
-void collect(struct generation* g) {
-  g->collect_count++;
-  gc_collect_stat_update();
+void* compacted_address(const struct space* space, void* ptr) {
+  if (!is_in_place(space, ptr)) return ptr;
+
+  return STELLA_REF_DECODE(get_gc_object(ptr)->stella_object.object_fields[0]);
+}
+
+// mark-sweep
+void sweep_generation(struct generation* g) {
+  // Младшие поколения переносятся в старшее обычной сборкой, как и перед сжатием
+  tenure_all = true;
+  collect(generations[g->number - 1]);
+  tenure_all = false;
 
 #ifdef DEBUG_LOGS
   print_separator();
-  printf("COLLECTING G_%d - COLLECTING NUMBER %d\n", g->number, g->collect_count);
+  printf("MARKING G_%d - COLLECTING NUMBER %" PRIu64 "\n", g->number, g->collect_count);
   print_gc_state();
 #endif
 
-  g->scan = g->to->next;
+  const uint64_t start = now_ns();
+  struct space* space = g->from;
+  struct free_lists* lists = space->free_lists;
+  g->collected_bytes += space_used(space);
 
-  for (int i = 0; i < gc_roots_top; i++) {
-    void **root_ptr = gc_roots[i];
-    *root_ptr = forward(g, *root_ptr);
-  }
+  // Свободные ячейки не помечаются, поэтому списки строятся заново при подметании вместе с новыми мертвыми объектами
+  memset(lists->marks, 0, mark_bitmap_size(space));
+  memset(lists->cells, 0, sizeof(lists->cells));
+  lists->free_bytes = 0;
+
+  size_t live_bytes = 0;
+  space->objects = mark_roots(space, &live_bytes);
+  lists->used = live_bytes;
+  lists->sweep = space->heap;
+  lists->sweep_end = space->next;
+  g->survived_bytes += live_bytes;
+
+  const uint64_t end = now_ns();
+  g->phase_ns[PHASE_MARK] += end - start;
 
 #ifdef DEBUG_LOGS
   print_separator();
-  printf("FORWARD ALL ROOTS\n");
+  printf("END OF MARKING\n");
   print_gc_state();
 #endif
+}
+
+void init_free_lists(struct space* space) {
+  space->free_lists = calloc(1, sizeof(struct free_lists));
+  if (space->free_lists == NULL) {
+    exit_with_out_memory_error();
+  }
+
+  space->free_lists->marks = calloc(mark_bitmap_size(space), 1);
+  if (space->free_lists->marks == NULL) {
+    exit_with_out_memory_error();
+  }
+  space->free_lists->sweep = space->heap;
+  space->free_lists->sweep_end = space->heap;
+}
+
+size_t mark_bitmap_size(const struct space* space) {
+  return (space->size / sizeof(stella_ref) + 7) / 8;
+}
+
+struct gc_object* alloc_cell(struct space* space, const size_t size) {
+  struct free_lists* lists = space->free_lists;
+
+  struct gc_object* cell = take_cell(space, size);
+  if (cell == NULL && lists->sweep < lists->sweep_end) {
+    const uint64_t start = now_ns();
+    while (cell == NULL && lists->sweep < lists->sweep_end) {
+      sweep_space(space, SWEEP_QUANTUM);
+      cell = take_cell(space, size);
+    }
+    generations[space->gen]->phase_ns[PHASE_SWEEP] += now_ns() - start;
+  }
+
+  if (cell != NULL) {
+    lists->reused_bytes += size;
+  } else {
+    // свободных ячеек нет - выделяем сдвигом next, при нехватке расширяясь внутри отображенного предела
+    if (!has_enough_space(space, size)) {
+      size_t grown = space->size * config.growth_factor;
+      if (grown < (size_t) (space->next - space->heap) + size) grown = space->next - space->heap + size;
+      if (grown > config.max_old_size) grown = config.max_old_size;
+      if (grown <= space->size) return NULL;
+      extend_space(space, grown);
+      if (!has_enough_space(space, size)) return NULL;
+    }
+
+    cell = space->next;
+    space->next += size;
+  }
+
+  cell->stella_object.object_header = 0;
+  space->objects++;
+  lists->used += size;
+  note_object_start(space, cell);
+  // повышенный объект сканируется из списка, а не по порядку адресов
+  push_object(&promoted, cell);
+
+  return cell;
+}
+
+struct gc_object* take_cell(struct space* space, const size_t size) {
+  struct free_lists* lists = space->free_lists;
+  const size_t words = size / sizeof(stella_ref);
+  const size_t min_words = MIN_CELL_SIZE / sizeof(stella_ref);
+
+  // сначала ячейка того же размера, иначе наименьшая из тех, остаток которых сам годится в ячейку
+  size_t class = words;
+  if (lists->cells[class] == NULL) {
+    class = words + min_words;
+    while (class < CELL_CLASSES && lists->cells[class] == NULL) {
+      class++;
+    }
+    if (class >= CELL_CLASSES) return NULL;
+  }
 
-  // run for all objects in prev generations and try find link to collected generation
-  for (int i = 0; i < g->number; i++) {
-    const struct generation* past_gen = generations[i];
+  struct gc_object* cell = lists->cells[class];
+  lists->cells[class] = STELLA_REF_DECODE(cell->stella_object.object_fields[0]);
+  lists->free_bytes -= class * sizeof(stella_ref);
 
-    for (void *ptr = past_gen->from->heap; ptr < past_gen->from->next; ptr += get_gc_object_size(ptr)) {
-      struct gc_object *obj = ptr;
-      const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->stella_object.object_header);
-      for (int j = 0; j < field_count; j++) {
-        obj->stella_object.object_fields[j] = forward(g, obj->stella_object.object_fields[j]);
+  if (class > words) {
+    free_cell(space, (void*) cell + size, (class - words) * sizeof(stella_ref));
+  }
+
+  return cell;
+}
+
+void free_cell(struct space* space, struct gc_object* cell, const size_t size) {
+  struct free_lists* lists = space->free_lists;
+  const size_t words = size / sizeof(stella_ref);
+  const int field_count = (size - sizeof(stella_object)) / sizeof(stella_ref);
+
+  cell->stella_object.object_header = STELLA_OBJECT_HEADER(TAG_ZERO, field_count) | STELLA_NAT_BOXED | FREE_CELL;
+  cell->stella_object.object_fields[0] = STELLA_REF_ENCODE(lists->cells[words]);
+  lists->cells[words] = cell;
+  lists->free_bytes += size;
+  note_object_start(space, cell);
+}
+
+void sweep_space(struct space* space, const size_t quantum) {
+  struct free_lists* lists = space->free_lists;
+  void* const limit = lists->sweep + quantum;
+  void* run = NULL;
+
+  void* ptr = lists->sweep;
+  while (ptr < lists->sweep_end && (ptr < limit || run != NULL)) {
+    struct gc_object* obj = ptr;
+    const size_t size = get_gc_object_size(obj);
+    if (is_marked(space, obj)) {
+      if (run != NULL) {
+        free_run(space, run, ptr);
+        run = NULL;
       }
+    } else if (run == NULL) {
+      run = ptr;
     }
+    ptr += size;
   }
 
-#ifdef DEBUG_LOGS
-  print_separator();
-  printf("FORWARD FIELDS OF OBJECT FROM EARLY GEN\n");
-  print_gc_state();
-#endif
+  lists->sweep = ptr;
+  if (run != NULL) {
+    free_run(space, run, ptr);
+  }
+}
+
+void free_run(struct space* space, void* start, void* end) {
+  struct free_lists* lists = space->free_lists;
+
+  // начала объектов внутри цепочки перестают быть началами, карты с ними пересчитываются по новым ячейкам
+  const size_t first_card = (start - space->heap) >> CARD_SHIFT;
+  const size_t last_card = (end - 1 - space->heap) >> CARD_SHIFT;
+  for (size_t card = first_card; card <= last_card; card++) {
+    uint16_t* card_start = &space->card_start[card];
+    void* object_start = space->heap + (card << CARD_SHIFT) + *card_start;
+    if (*card_start != NO_OBJECT_START && object_start >= start && object_start < end) {
+      *card_start = NO_OBJECT_START;
+    }
+  }
+
+  // цепочка в конце места возвращается next (после нее ничего не выделялось с момента пометки)
+  if (end == space->next) {
+    space->next = start;
+    lists->sweep = lists->sweep_end = start;
+    release_range(start, end);
+    return;
+  }
+
+  // цепочка режется на ячейки наибольшего размера, последние две - так, чтобы остаток тоже был ячейкой
+  while (start < end) {
+    const size_t size = next_cell_size(end - start);
+    free_cell(space, start, size);
+    start += size;
+  }
+  note_object_start(space, end);
+}
+
+size_t next_cell_size(const size_t left) {
+  if (left <= MAX_CELL_SIZE) return left;
+
+  return left - MAX_CELL_SIZE >= MIN_CELL_SIZE ? MAX_CELL_SIZE : left - MIN_CELL_SIZE;
+}
+
+// parallel copying
+bool is_parallel(const struct generation* g) {
+  // на маленьком поколении запуск потоков обходится дороже самого переноса
+  if (config.gc_threads < 2 || config.old_collector != GC_OLD_COPYING || g != g_old || space_used(g->from) < PARALLEL_MIN_SIZE) {
+    return false;
+  }
+
+  // Буферы переноса теряют хвосты: каждый закрытый - меньше объекта и ячейки, а последний у каждого потока - целиком.
+  // Сборка идет параллельно, только если to вмещает все собираемое вместе с этими потерями
+  size_t collected = 0;
+  for (int i = 0; i <= g->number; i++) {
+    collected += space_used(generations[i]->from);
+    if (generations[i]->survivor_from != NULL) {
+      collected += space_used(generations[i]->survivor_from);
+    }
+  }
+  const size_t lost = collected / (PLAB_SIZE / (MAX_CELL_SIZE + MIN_CELL_SIZE)) + config.gc_threads * PLAB_SIZE;
+  return collected + lost <= g->to->size;
+}
+
+void start_workers(struct generation* g) {
+  if (gc_pool.count == 0) {
+    gc_pool.workers = aligned_alloc(_Alignof(struct gc_worker), config.gc_threads * sizeof(struct gc_worker));
+    if (gc_pool.workers == NULL) {
+      exit_with_out_memory_error();
+    }
+    memset(gc_pool.workers, 0, config.gc_threads * sizeof(struct gc_worker));
+
+    for (int i = 0; i < config.gc_threads; i++) {
+      struct gc_worker* worker = &gc_pool.workers[i];
+      deque_init(&worker->deque);
+      worker->seed = i + 1;
+      if (i > 0 && pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+        // потоков меньше, чем просили: собираем теми, что есть
+        break;
+      }
+      gc_pool.count = i + 1;
+    }
+  }
+
+  gc_pool.g = g;
+}
+
+void* worker_main(void* arg) {
+  struct gc_worker* worker = arg;
+  uint64_t epoch = 0;
+
+  while (true) {
+    pthread_mutex_lock(&gc_pool.lock);
+    while (gc_pool.epoch == epoch) {
+      pthread_cond_wait(&gc_pool.start, &gc_pool.lock);
+    }
+    epoch = gc_pool.epoch;
+    pthread_mutex_unlock(&gc_pool.lock);
+
+    parallel_work(worker);
+
+    pthread_mutex_lock(&gc_pool.lock);
+    if (--gc_pool.running == 0) {
+      pthread_cond_signal(&gc_pool.done);
+    }
+    pthread_mutex_unlock(&gc_pool.lock);
+  }
+
+  return NULL;
+}
+
+void parallel_scan(struct generation* g) {
+  pthread_mutex_lock(&gc_pool.lock);
+  gc_pool.idle = 0;
+  gc_pool.running = gc_pool.count - 1;
+  gc_pool.epoch++;
+  pthread_cond_broadcast(&gc_pool.start);
+  pthread_mutex_unlock(&gc_pool.lock);
+
+  parallel_work(&gc_pool.workers[0]);
+
+  pthread_mutex_lock(&gc_pool.lock);
+  while (gc_pool.running > 0) {
+    pthread_cond_wait(&gc_pool.done, &gc_pool.lock);
+  }
+  pthread_mutex_unlock(&gc_pool.lock);
+
+  for (int i = 0; i < gc_pool.count; i++) {
+    struct gc_worker* worker = &gc_pool.workers[i];
+    g->to->objects += worker->objects;
+    gc_pool.steals += worker->steals;
+    worker->objects = 0;
+    worker->steals = 0;
+    deque_release_retired(&worker->deque);
+  }
+  gc_pool.collections++;
+}
+
+void parallel_work(struct gc_worker* worker) {
+  struct generation* g = gc_pool.g;
+
+  while (true) {
+    struct gc_object* obj = deque_pop(&worker->deque);
+    if (obj == NULL) {
+      obj = steal_work(worker);
+    }
+    if (obj == NULL) {
+      if (!await_work(worker)) break;
+      continue;
+    }
+
+    // Как в chase, последняя новая копия сканируется сразу, а в очередь (и другим потокам) уходят остальные.
+    // В старшем поколении после его сборки нет ссылок в младшие, поэтому карты не помечаются
+    while (obj != NULL) {
+      struct gc_object* next = NULL;
+      const int pointer_count = STELLA_OBJECT_HEADER_POINTER_COUNT(obj->stella_object.object_header);
+      for (int i = 0; i < pointer_count; i++) {
+        struct gc_object* grey;
+        void* field = parallel_forward(g, worker, STELLA_REF_DECODE(obj->stella_object.object_fields[i]), &grey);
+        obj->stella_object.object_fields[i] = STELLA_REF_ENCODE(field);
+        if (grey != NULL) {
+          if (next != NULL) {
+            deque_push(&worker->deque, next);
+          }
+          next = grey;
+        }
+      }
+      obj = next;
+    }
+  }
 
-  // changed objects
-  for (int i = 0; i < changed_nodes_top; i++) {
-    stella_object *obj = changed_nodes[i];
-    const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->object_header);
-    for (int j = 0; j < field_count; j++) {
-      obj->object_fields[j] = forward(g, obj->object_fields[j]);
+  plab_retire(g->to, worker);
+}
+
+bool await_work(struct gc_worker* worker) {
+  // Простаивающий поток ничего не держит и его очередь пуста, а класть в очереди могут только занятые потоки,
+  // поэтому, когда простаивают все, работы больше не появится
+  __atomic_add_fetch(&gc_pool.idle, 1, __ATOMIC_SEQ_CST);
+  for (int attempt = 0; __atomic_load_n(&gc_pool.idle, __ATOMIC_SEQ_CST) < gc_pool.count; attempt++) {
+    for (int i = 0; i < gc_pool.count; i++) {
+      if (&gc_pool.workers[i] != worker && !deque_is_empty(&gc_pool.workers[i].deque)) {
+        __atomic_sub_fetch(&gc_pool.idle, 1, __ATOMIC_SEQ_CST);
+        return true;
+      }
+    }
+
+    // долго простаивающий поток засыпает, чтобы не отнимать ядро у тех, кто еще копирует
+    if (attempt < IDLE_SPINS) {
+      sched_yield();
+    } else {
+      nanosleep(&(struct timespec) { .tv_nsec = IDLE_SLEEP_NS }, NULL);
+    }
+  }
+
+  return false;
+}
+
+struct gc_object* steal_work(struct gc_worker* worker) {
+  if (gc_pool.count < 2) return NULL;
+
+  // жертва выбирается случайно, чтобы воры не выстраивались в очередь к одному потоку
+  worker->seed = worker->seed * 1103515245 + 12345;
+  const int first = (worker->seed >> 16) % gc_pool.count;
+  for (int i = 0; i < gc_pool.count; i++) {
+    struct gc_worker* victim = &gc_pool.workers[(first + i) % gc_pool.count];
+    if (victim == worker) continue;
+
+    struct gc_object* obj = deque_steal(&victim->deque);
+    if (obj != NULL) {
+      worker->steals++;
+      return obj;
+    }
+  }
+
+  return NULL;
+}
+
+void* parallel_forward_root(struct generation* g, void* p) {
+  struct gc_worker* worker = &gc_pool.workers[0];
+  struct gc_object* grey;
+  void* result = parallel_forward(g, worker, p, &grey);
+  if (grey != NULL) {
+    deque_push(&worker->deque, grey);
+  }
+
+  return result;
+}
+
+void* parallel_forward(struct generation* g, struct gc_worker* worker, void* p, struct gc_object** grey) {
+  *grey = NULL;
+  if (!is_collected(g, p)) {
+    return p;
+  }
+
+  struct gc_object* obj = get_gc_object(p);
+  int* header = &obj->stella_object.object_header;
+  int value = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+  while (true) {
+    // новый адрес пишется в первое поле до того, как выставляется FORWARDED
+    if (value & FORWARDED) {
+      return get_stella_object(get_forwarded(obj));
+    }
+    if (value & COPYING) {
+      value = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+      continue;
+    }
+    if (__atomic_compare_exchange_n(header, &value, value | COPYING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+
+  const size_t size = get_stella_object_size(&obj->stella_object);
+  struct gc_object* copy = plab_alloc(g->to, worker, size);
+  if (copy == NULL) {
+    exit_with_out_memory_error();
+  }
+
+  const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(value);
+  copy->stella_object.object_header = value;
+  for (int i = 0; i < field_count; i++) {
+    copy->stella_object.object_fields[i] = obj->stella_object.object_fields[i];
+  }
+  note_object_start_atomic(g->to, copy);
+  tag_stat_update(g, obj, g->to);
+  worker->objects++;
+
+  obj->stella_object.object_fields[0] = STELLA_REF_ENCODE(get_stella_object(copy));
+  __atomic_store_n(header, value | FORWARDED, __ATOMIC_RELEASE);
+
+  if (STELLA_OBJECT_HEADER_POINTER_COUNT(value) > 0) {
+    *grey = copy;
+  }
+  return get_stella_object(copy);
+}
+
+struct gc_object* plab_alloc(struct space* space, struct gc_worker* worker, const size_t size) {
+  // остаток буфера после объекта закрывается мертвой ячейкой, поэтому он либо пуст, либо вмещает ячейку
+  const size_t left = worker->plab_end - worker->plab_next;
+  if (size != left && size + MIN_CELL_SIZE > left) {
+    plab_retire(space, worker);
+
+    void* next = __atomic_load_n(&space->next, __ATOMIC_RELAXED);
+    size_t chunk;
+    do {
+      const size_t free = (size_t) (space->heap + space->size - next);
+      chunk = free < PLAB_SIZE ? free : PLAB_SIZE;
+      // в конце места буфер урезается до остатка, а если и тот не закрыть ячейкой - до самого объекта
+      if (chunk != size && chunk < size + MIN_CELL_SIZE) {
+        chunk = size;
+      }
+      if (chunk > free) {
+        return NULL;
+      }
+    } while (!__atomic_compare_exchange_n(&space->next, &next, next + chunk, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    worker->plab_next = next;
+    worker->plab_end = next + chunk;
+  }
+
+  struct gc_object* result = worker->plab_next;
+  worker->plab_next += size;
+  return result;
+}
+
+void plab_retire(struct space* space, struct gc_worker* worker) {
+  void* start = worker->plab_next;
+  while (start < worker->plab_end) {
+    struct gc_object* cell = start;
+    const size_t size = next_cell_size(worker->plab_end - start);
+    const int field_count = (size - sizeof(stella_object)) / sizeof(stella_ref);
+    cell->stella_object.object_header = STELLA_OBJECT_HEADER(TAG_ZERO, field_count) | STELLA_NAT_BOXED | FREE_CELL;
+    cell->stella_object.object_fields[0] = STELLA_REF_ENCODE(NULL);
+    note_object_start_atomic(space, cell);
+    start += size;
+  }
+
+  worker->plab_next = worker->plab_end = NULL;
+}
+
+void note_object_start_atomic(struct space* space, const struct gc_object* obj) {
+  const size_t offset = (const void*) obj - space->heap;
+  const uint16_t in_card = offset & (CARD_SIZE - 1);
+  uint16_t* start = &space->card_start[offset >> CARD_SHIFT];
+
+  // карту делят только соседние буферы переноса, так что CAS почти никогда не повторяется
+  uint16_t current = __atomic_load_n(start, __ATOMIC_RELAXED);
+  while ((current == NO_OBJECT_START || current > in_card)
+         && !__atomic_compare_exchange_n(start, &current, in_card, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+void deque_init(struct gc_deque* deque) {
+  const size_t capacity = 1024;
+  deque->buffer = malloc(sizeof(struct deque_buffer) + capacity * sizeof(struct gc_object*));
+  if (deque->buffer == NULL) {
+    exit_with_out_memory_error();
+  }
+  deque->buffer->capacity = capacity;
+  deque->buffer->retired = NULL;
+  deque->top = 0;
+  deque->bottom = 0;
+}
+
+void deque_push(struct gc_deque* deque, struct gc_object* obj) {
+  const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  const int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  struct deque_buffer* buffer = __atomic_load_n(&deque->buffer, __ATOMIC_RELAXED);
+
+  if (bottom - top >= (int64_t) buffer->capacity) {
+    // массив удваивается, а прежний остается до конца сборки: вор мог уже взять на него указатель
+    const size_t capacity = buffer->capacity * 2;
+    struct deque_buffer* grown = malloc(sizeof(struct deque_buffer) + capacity * sizeof(struct gc_object*));
+    if (grown == NULL) {
+      exit_with_out_memory_error();
+    }
+    grown->capacity = capacity;
+    grown->retired = buffer;
+    for (int64_t i = top; i < bottom; i++) {
+      grown->items[i & (capacity - 1)] = __atomic_load_n(&buffer->items[i & (buffer->capacity - 1)], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&deque->buffer, grown, __ATOMIC_RELEASE);
+    buffer = grown;
+  }
+
+  __atomic_store_n(&buffer->items[bottom & (buffer->capacity - 1)], obj, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+struct gc_object* deque_pop(struct gc_deque* deque) {
+  const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  struct deque_buffer* buffer = __atomic_load_n(&deque->buffer, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (top > bottom) {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  struct gc_object* obj = __atomic_load_n(&buffer->items[bottom & (buffer->capacity - 1)], __ATOMIC_RELAXED);
+  if (top == bottom) {
+    // последний объект мог одновременно забрать вор
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      obj = NULL;
     }
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+
+  return obj;
+}
+
+struct gc_object* deque_steal(struct gc_deque* deque) {
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  const int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) {
+    return NULL;
+  }
+
+  struct deque_buffer* buffer = __atomic_load_n(&deque->buffer, __ATOMIC_ACQUIRE);
+  struct gc_object* obj = __atomic_load_n(&buffer->items[top & (buffer->capacity - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+
+  return obj;
+}
+
+bool deque_is_empty(struct gc_deque* deque) {
+  return __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST) >= __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+}
 
-    changed_nodes_top = 0;
+void deque_release_retired(struct gc_deque* deque) {
+  while (deque->buffer->retired != NULL) {
+    struct deque_buffer* retired = deque->buffer->retired;
+    deque->buffer->retired = retired->retired;
+    free(retired);
   }
+}
+
+// incremental copying
+static void incremental_forward_root_slot(void** slot, void* g) {
+  *slot = incremental_forward(g, *slot);
+}
+
+void incremental_start(struct generation* g) {
+  // Младшие поколения переносятся в старшее обычной сборкой, как перед сжатием: тогда в них не остается ссылок
+  // в собираемое полупространство, и повышение во время инкрементальной сборки его не касается
+  tenure_all = true;
+  collect(generations[g->number - 1]);
+  tenure_all = false;
 
 #ifdef DEBUG_LOGS
   print_separator();
-  printf("FORWARD CHANGED OBJECT FIELDS\n");
+  printf("STARTING INCREMENTAL G_%d - COLLECTING NUMBER %" PRIu64 "\n", g->number, g->collect_count);
   print_gc_state();
 #endif
 
-  while (g->scan < g->to->next) {
+  const uint64_t start = now_ns();
+  g->collected_bytes += space_used(g->from);
+
+  // Сколько объектов переживет сборку, заранее неизвестно, поэтому новое полупространство должно вместить все
+  // собираемое и резерв под повышение, пока сборка идет
+  const size_t size = reserved_size(g, space_used(g->from));
+  if (size > g->to->size) {
+    resize_space(g->to, size);
+  }
+
+  struct space* buff = g->from;
+  g->from = g->to;
+  g->to = buff;
+  generations[g->number - 1]->to = g->from;
+  g->scan = g->from->next;
+
+  incremental.active = true;
+  incremental.step_next = g->from->next;
+  incremental.copied_bytes = 0;
+  incremental.cycles++;
+
+  const uint64_t roots_start = now_ns();
+  for_each_root(incremental_forward_root_slot, g);
+
+  const uint64_t end = now_ns();
+  g->phase_ns[PHASE_FLIP] += roots_start - start;
+  g->phase_ns[PHASE_ROOTS] += end - roots_start;
+}
+
+void incremental_step(struct generation* g, const size_t quantum) {
+  const uint64_t start = now_ns();
+  incremental.steps++;
+
+  // объекты нового полупространства указывают только в него и в собираемое (младшие поколения туда не ссылаются)
+  size_t scanned = 0;
+  while (g->scan < g->from->next && scanned < quantum) {
     struct gc_object *obj = g->scan;
-    const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->stella_object.object_header);
-    for (int i = 0; i < field_count; i++) {
-      obj->stella_object.object_fields[i] = forward(g, obj->stella_object.object_fields[i]);
+    const int pointer_count = STELLA_OBJECT_HEADER_POINTER_COUNT(obj->stella_object.object_header);
+    for (int i = 0; i < pointer_count; i++) {
+      void* field = incremental_forward(g, STELLA_REF_DECODE(obj->stella_object.object_fields[i]));
+      obj->stella_object.object_fields[i] = STELLA_REF_ENCODE(field);
     }
 
-    g->scan += get_gc_object_size(obj);
+    const size_t size = get_gc_object_size(obj);
+    g->scan += size;
+    scanned += size;
+  }
+
+  const uint64_t end = now_ns();
+  g->phase_ns[PHASE_SCAN] += end - start;
+  incremental.step_next = g->from->next;
+
+  if (g->scan == g->from->next) {
+    incremental_finish(g);
   }
+}
+
+void incremental_finish(struct generation* g) {
+  const uint64_t start = now_ns();
+  incremental.active = false;
+  g->survived_bytes += incremental.copied_bytes;
+
+  reset_space(g->to);
+  release_space(g->to);
+  g->phase_ns[PHASE_FLIP] += now_ns() - start;
 
 #ifdef DEBUG_LOGS
   print_separator();
-  printf("SCAN TO NEXT\n");
+  printf("END OF INCREMENTAL G_%d\n", g->number);
   print_gc_state();
 #endif
 
-  if (g->from->gen == g->to->gen) { // copying gc
-    void *buff = g->from;
-    g->from = g->to;
-    g->to = buff;
+  // Живыми доказаны только перенесенные объекты: повышенное во время сборки не проверялось и может быть мусором,
+  // поэтому рост по занятому месту раздувал бы поколение (особенно после доделанной в одну паузу сборки)
+  grow_generation(g, incremental.copied_bytes);
+}
+
+void* incremental_forward(struct generation* g, void* p) {
+  if (!is_in_place(g->to, p)) {
+    return p;
+  }
 
-    g->to->next = g->to->heap;
+  struct gc_object* obj = get_gc_object(p);
+  if (is_forwarded(obj)) {
+    return get_stella_object(get_forwarded(obj));
+  }
 
-    struct generation* past = generations[g->from->gen - 1];
-    past->to = g->from;
-    past->scan = g->from->heap; // i hope its will work (run from start because struct of from can change)
-  } else { // generations
-    struct generation* current = generations[g->from->gen];
-    const struct generation* next = generations[g->to->gen];
-    current->from->next = g->from->heap;
-    current->to = next->from;
+  // место под все собираемое зарезервировано (см. has_promotion_room)
+  const size_t size = get_stella_object_size(&obj->stella_object);
+  struct gc_object* copy = alloc_in_space(g->from, size);
+  if (copy == NULL) {
+    exit_with_out_memory_error();
   }
 
-#ifdef DEBUG_LOGS
-  print_separator();
-  printf("END OF COLLECTING\n");
-  print_gc_state();
-#endif
-}
\ No newline at end of file
+  const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->stella_object.object_header);
+  copy->stella_object.object_header = obj->stella_object.object_header;
+  for (int i = 0; i < field_count; i++) {
+    copy->stella_object.object_fields[i] = obj->stella_object.object_fields[i];
+  }
+  set_forwarded(obj, copy);
+  incremental.copied_bytes += size;
+
+  return get_stella_object(copy);
+}
@@ -3,20 +3,194 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
+#ifdef STELLA_GC_NO_STATS
 /** This macro is used whenever the runtime wants to READ a heap object's field.
+ * Reads are not counted in this build profile, so there is no barrier at all.
  */
-#define GC_READ_BARRIER(object, field_index, read_code) (void *)(gc_read_barrier(object, field_index), read_code) // NO BARRIER
+#define GC_READ_BARRIER(object, field_index, read_code) (void *)(read_code)
 /** This macro is used whenever the runtime wants to OVERWRITE a heap object's field.
  * This is NOT used when initializing object fields.
+ * Writes are not counted in this build profile, so the barrier is an inline card mark.
+ * contents is evaluated after write_code and should re-read the field (see the profile below).
  */
-#define GC_WRITE_BARRIER(object, field_index, contents, write_code) (gc_write_barrier(object, field_index, contents), write_code) // NO BARRIER
+#define GC_WRITE_BARRIER(object, field_index, contents, write_code) (write_code, gc_remember(object, contents), (void *)(contents))
+#else
+/** This macro is used whenever the runtime wants to READ a heap object's field.
+ */
+#define GC_READ_BARRIER(object, field_index, read_code) (void *)(gc_read_barrier(object, field_index), read_code)
+/** This macro is used whenever the runtime wants to OVERWRITE a heap object's field.
+ * This is NOT used when initializing object fields.
+ * contents is evaluated after write_code, once for the barrier and once as the value of the whole expression,
+ * so it should re-read the field (as with GC_INIT_BARRIER) instead of repeating the stored expression.
+ */
+#define GC_WRITE_BARRIER(object, field_index, contents, write_code) (write_code, gc_write_barrier(object, field_index, contents), (void *)(contents))
+#endif
+/** This macro is used whenever the runtime INITIALIZES a heap object's field.
+ * A collection may promote an object before all of its fields are initialized,
+ * so initialization must keep the remembered set up to date as well.
+ * contents is evaluated after init_code, so it should re-read the field instead of repeating the initializer.
+ */
+#define GC_INIT_BARRIER(object, field_index, contents, init_code) (init_code, gc_remember(object, contents))
+
+/** How the pages of a dead oldest generation semispace are returned to the OS after each flip. */
+typedef enum {
+  GC_RELEASE_DEFAULT,  /**< Taken from STELLA_GC_RELEASE (none, dontneed or free), dontneed if not set. */
+  GC_RELEASE_NONE,     /**< Keep the pages resident. */
+  GC_RELEASE_DONTNEED, /**< madvise(MADV_DONTNEED): drop the pages at once, they come back zeroed on next use. */
+  GC_RELEASE_FREE      /**< madvise(MADV_FREE): let the OS reclaim the pages lazily, under memory pressure. */
+} gc_release_policy;
+
+/** How the oldest generation is collected. */
+typedef enum {
+  GC_OLD_DEFAULT,  /**< Taken from STELLA_GC_OLD_COLLECTOR (copying, compact or sweep), copying if not set. */
+  GC_OLD_COPYING,  /**< Copy survivors between two semispaces: short pauses, but half of the space always sits idle. */
+  GC_OLD_COMPACT,  /**< Mark and slide survivors in place (allocation order is kept): one space, no copy reserve. */
+  GC_OLD_SWEEP     /**< Mark and sweep lazily into size-segregated free lists: old objects never move. */
+} gc_old_collector;
+
+/** Heap sizing parameters.
+ * Zero fields are taken from the environment variables
+ * STELLA_GC_NURSERY_SIZE, STELLA_GC_OLD_SIZE, STELLA_GC_MAX_OLD_SIZE (sizes in bytes, K/M/G suffixes allowed),
+ * STELLA_GC_GROWTH_FACTOR, STELLA_GC_RELEASE, STELLA_GC_HUGE_PAGES, STELLA_GC_PREFAULT and those named below,
+ * or from the compile-time defaults if those are not set.
+ * The nursery is resized between collections only if a pause target or a GC time goal is set;
+ * nursery_size is then the initial size.
+ */
+typedef struct {
+  size_t nursery_size;  /**< Size of the generation 0 space in bytes. */
+  int generation_count; /**< Number of generations, 2 to 8 (STELLA_GC_GENERATIONS). */
+  double generation_ratio; /**< Size ratio between consecutive generations (STELLA_GC_GENERATION_RATIO). */
+  size_t old_size;      /**< Initial size of each oldest generation semispace in bytes. */
+  size_t max_old_size;  /**< Hard limit for the size of an oldest generation semispace in bytes. */
+  double growth_factor; /**< Factor by which oldest generation semispaces grow when survivors do not fit. */
+  gc_old_collector old_collector; /**< Collector of the oldest generation. */
+  gc_release_policy release; /**< What to do with the pages of a dead semispace after a flip (or freed by compaction or sweeping). */
+  int huge_pages;       /**< Nonzero to back the nursery with transparent huge pages (STELLA_GC_HUGE_PAGES=1). */
+  int prefault;         /**< Nonzero to touch every nursery page at startup (STELLA_GC_PREFAULT=1). */
+  double pause_target_us; /**< Adaptive nursery: longest acceptable minor pause in microseconds (STELLA_GC_PAUSE_TARGET). */
+  double gc_time_goal;  /**< Adaptive nursery: largest acceptable share of time spent in minor collections (STELLA_GC_TIME_GOAL). */
+  size_t min_nursery_size; /**< Adaptive nursery: lower bound of the nursery size in bytes (STELLA_GC_MIN_NURSERY_SIZE). */
+  size_t max_nursery_size; /**< Adaptive nursery: upper bound of the nursery size in bytes (STELLA_GC_MAX_NURSERY_SIZE). */
+  size_t survivor_size; /**< Size of each of the two generation 0 survivor semispaces in bytes (STELLA_GC_SURVIVOR_SIZE). */
+  int tenure_age;       /**< Number of minor collections an object survives before promotion, 1 to 15 (STELLA_GC_TENURE_AGE). */
+  int gc_threads;       /**< Number of threads copying the oldest generation, 1 to 64 (STELLA_GC_THREADS); 1 copies on the mutator alone. */
+  size_t incremental_quantum; /**< Incremental copying of the oldest generation: minimum bytes scanned per pause, 0 to stop the world
+                                    (STELLA_GC_INCREMENTAL_QUANTUM). Needs the read barrier, so ignored with STELLA_GC_NO_STATS. */
+} gc_config;
+
+/** Initialize the heap with a given configuration (NULL means environment/defaults only).
+ * Should be called once at startup; otherwise the first gc_alloc calls gc_init(NULL).
+ * Calls after the heap has been initialized are ignored.
+ */
+void gc_init(const gc_config *config);
+
+/** Size of the GC's own header placed in front of every heap object.
+ * The GC keeps its state (the forwarding address) in the Stella object itself, so there is none.
+ * Heap objects must therefore have room for at least one field.
+ */
+#define GC_OBJECT_HEADER_SIZE 0
+
+/** Bump pointer and end of the nursery (generation 0) used by the inline allocation fast path.
+ * Both are NULL until the heap is initialized, so the first allocation always takes the slow path.
+ */
+extern char *gc_nursery_next;
+extern char *gc_nursery_limit;
+/** Number of objects allocated in the nursery and not yet accounted in the GC statistics. */
+extern size_t gc_nursery_objects;
+
+/** Bounds of the current oldest generation from-space and its card table used by the inline card marking.
+ * A card covers 2^GC_CARD_SHIFT bytes and is dirty if an object starting in it may point into a younger generation,
+ * that is into the nursery or into the young block: the two survivor semispaces of generation 0
+ * followed by the intermediate generations (gc_middle_start to gc_middle_end, empty with two generations).
+ */
+#define GC_CARD_SHIFT 9
+extern char *gc_nursery_start;
+extern char *gc_young_start;
+extern char *gc_young_end;
+extern char *gc_middle_start;
+extern char *gc_middle_end;
+extern char *gc_old_start;
+extern char *gc_old_end;
+extern uint8_t *gc_old_cards;
+/** List of dirty cards of the oldest generation from-space, so that a minor collection visits only those. */
+extern uint32_t *gc_old_dirty;
+extern size_t gc_old_dirty_count;
+
+/** Allocation slow path: initializes the heap if needed, collects garbage and allocates.
+ * Must only be called by gc_alloc.
+ */
+void* gc_alloc_slow(size_t size_in_bytes);
 
 /** Allocate an object on the heap of AT LEAST size_in_bytes bytes.
  * If necessary, this should start/continue garbage collection.
  * Returns a pointer to the newly allocated object.
+ * The nursery is zeroed after each collection, so the fast path only bumps the pointer.
+ */
+static inline void* gc_alloc(const size_t size_in_bytes) {
+  char *object = gc_nursery_next;
+  const size_t size = size_in_bytes + GC_OBJECT_HEADER_SIZE;
+
+  if ((size_t)(gc_nursery_limit - object) < size) {
+    return gc_alloc_slow(size_in_bytes);
+  }
+
+  gc_nursery_next = object + size;
+#ifndef STELLA_GC_NO_STATS
+  gc_nursery_objects++;
+#endif
+  return object + GC_OBJECT_HEADER_SIZE;
+}
+
+/** Bulk allocation slow path: collects garbage at most once and reserves the objects.
+ * Must only be called by gc_alloc_n.
  */
-void* gc_alloc(size_t size_in_bytes);
+void* gc_alloc_n_slow(size_t *count, size_t size_in_bytes);
+
+/** Allocate up to *count objects of AT LEAST size_in_bytes bytes each in one contiguous block.
+ * Object i starts at the returned pointer plus i * (size_in_bytes + GC_OBJECT_HEADER_SIZE).
+ * At most one garbage collection happens, before any object is reserved.
+ * On return *count holds the number of allocated objects (at least one),
+ * which is less than requested only if the block does not fit in an empty nursery,
+ * so a long chain is built in several calls.
+ */
+static inline void* gc_alloc_n(size_t *count, const size_t size_in_bytes) {
+  char *object = gc_nursery_next;
+  const size_t size = (size_in_bytes + GC_OBJECT_HEADER_SIZE) * *count;
+
+  if ((size_t)(gc_nursery_limit - object) < size) {
+    return gc_alloc_n_slow(count, size_in_bytes);
+  }
+
+  gc_nursery_next = object + size;
+#ifndef STELLA_GC_NO_STATS
+  gc_nursery_objects += *count;
+#endif
+  return object + GC_OBJECT_HEADER_SIZE;
+}
+
+/** Remembered set slow path for objects of the intermediate generations. Must only be called by gc_remember. */
+void gc_remember_middle(void *object, const void *contents);
+
+/** Remember that contents has been stored into object:
+ * dirties the card of object if this creates a reference from an older generation into a younger one.
+ * Most initialized objects are young themselves, so the checks of object go first.
+ */
+static inline void gc_remember(void *object, const void *contents) {
+  if ((char*)object >= gc_old_start && (char*)object < gc_old_end) {
+    if (((const char*)contents >= gc_nursery_start && (const char*)contents < gc_nursery_limit)
+        || ((const char*)contents >= gc_young_start && (const char*)contents < gc_young_end)) {
+      const size_t card = ((char*)object - GC_OBJECT_HEADER_SIZE - gc_old_start) >> GC_CARD_SHIFT;
+      if (gc_old_cards[card] == 0) {
+        gc_old_cards[card] = 1;
+        gc_old_dirty[gc_old_dirty_count++] = card;
+      }
+    }
+  } else if ((char*)object >= gc_middle_start && (char*)object < gc_middle_end) {
+    gc_remember_middle(object, contents);
+  }
+}
 
 /** GC-specific code which must be executed on each READ operation.
  */
@@ -34,6 +208,19 @@ void gc_push_root(void **object);
  */
 void gc_pop_root(void **object);
 
+/** Push a frame of count consecutive roots (variables) starting at slots on the GC's stack of roots.
+ * A frame costs a single entry, so a function may register all of its locals at once:
+ *
+ *   stella_object *regs[4] = { 0 };
+ *   gc_push_frame((void**)regs, 4);
+ *   ...
+ *   gc_pop_frame();
+ */
+void gc_push_frame(void **slots, int count);
+/** Pop the frame (or the single root) at the top of the GC's stack of roots.
+ */
+void gc_pop_frame();
+
 /** Print GC statistics. Output must include at least:
  *
  * 1. Total allocated memory (bytes and objects).
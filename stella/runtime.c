@@ -1,10 +1,14 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 #include "runtime.h"
 #include "gc.h"
 
-int total_allocated_fields = 0;
+uint64_t total_allocated_fields = 0;
+stella_tag_stats tag_stats[STELLA_TAG_COUNT];
+uint64_t nat_rec_iterations = 0;
+uint64_t nat_rec_step_closures = 0;
 
 stella_object the_ZERO = { .object_header = TAG_ZERO, .object_fields = {} } ;
 stella_object the_UNIT = { .object_header = TAG_UNIT, .object_fields = {} } ;
@@ -15,48 +19,252 @@ stella_object the_TRUE = { .object_header = TAG_TRUE, .object_fields = {} } ;
 const int FIELD_COUNT_MASK = (1 << 8) - (1 << 4) ;
 const int TAG_MASK         = (1 << 4) - (1 << 0) ;
 
-stella_object* alloc_stella_object(enum TAG tag, int fields_count) {
-  stella_object *obj;
-  total_allocated_fields += fields_count;
-  switch (tag) {
-    // do not allocate constant objects
-    case TAG_ZERO: return &the_ZERO;
-    case TAG_FALSE: return &the_FALSE;
-    case TAG_TRUE: return &the_TRUE;
-    case TAG_UNIT: return &the_UNIT;
-    case TAG_EMPTY: return &the_EMPTY;
-    case TAG_TUPLE: if (fields_count == 0) { return &the_EMPTY_TUPLE; }
-    // allocate an object with at least one field (or an unknown tag)
-    default:
-      obj = gc_alloc(sizeof(stella_object) + fields_count * sizeof(void*));
-      STELLA_OBJECT_INIT_TAG(obj, tag);
-      STELLA_OBJECT_INIT_FIELDS_COUNT(obj, fields_count);
-      return obj;
+/** Static Nat objects for 1..STELLA_SMALL_NAT_MAX (outside of the heap, so the GC never copies them):
+ * succ chains ending with the_ZERO, or boxed Nats with STELLA_BINARY_NAT. The entry 0 is not used.
+ */
+struct small_nat { int object_header; stella_ref object_fields[1]; };
+
+#if STELLA_SMALL_NAT_MAX >= (1 << 12)
+#error "STELLA_SMALL_NAT_MAX must be below 4096"
+#endif
+
+#if defined(STELLA_COMPRESSED_REFS) && !defined(STELLA_BINARY_NAT)
+// a compressed reference to the previous entry is a truncated address, which is not a constant expression,
+// so succ chains with STELLA_COMPRESSED_REFS are linked on first use
+static struct small_nat small_nats[STELLA_SMALL_NAT_MAX + 1];
+
+static stella_object *small_nat(const int n) {
+  if (small_nats[STELLA_SMALL_NAT_MAX].object_header == 0) {
+    for (int i = 1; i <= STELLA_SMALL_NAT_MAX; i++) {
+      small_nats[i].object_header = STELLA_OBJECT_HEADER(TAG_SUCC, 1);
+      small_nats[i].object_fields[0] = i == 1 ? STELLA_REF_ENCODE(&the_ZERO) : STELLA_REF_ENCODE(&small_nats[i - 1]);
+    }
   }
+  // negative numbers come from subtraction in generated code and are truncated to zero
+  return n <= 0 ? &the_ZERO : (stella_object*)&small_nats[n];
 }
+#else
+// otherwise every entry is a constant (a full pointer to the previous entry or the value itself),
+// so the table is initialized at compile time and is read-only (.rodata, or .data.rel.ro for pointers in a PIE build):
+// no check on use, no writable copy
+#ifdef STELLA_BINARY_NAT
+#define SMALL_NAT(n) { STELLA_OBJECT_HEADER(TAG_SUCC, 1) | STELLA_NAT_BOXED, { STELLA_REF_ENCODE((size_t)(n)) } },
+#else
+#define SMALL_NAT(n) { STELLA_OBJECT_HEADER(TAG_SUCC, 1), { (n) == 1 ? (stella_ref)&the_ZERO : (stella_ref)&small_nats[(n) - 1] } },
+#endif
+// SMALL_NATS_k(n) - 2^k entries for n, n + 1, ...; the table is put together from the set bits of STELLA_SMALL_NAT_MAX
+#define SMALL_NATS_0(n) SMALL_NAT(n)
+#define SMALL_NATS_1(n) SMALL_NATS_0(n) SMALL_NATS_0((n) + 1)
+#define SMALL_NATS_2(n) SMALL_NATS_1(n) SMALL_NATS_1((n) + 2)
+#define SMALL_NATS_3(n) SMALL_NATS_2(n) SMALL_NATS_2((n) + 4)
+#define SMALL_NATS_4(n) SMALL_NATS_3(n) SMALL_NATS_3((n) + 8)
+#define SMALL_NATS_5(n) SMALL_NATS_4(n) SMALL_NATS_4((n) + 16)
+#define SMALL_NATS_6(n) SMALL_NATS_5(n) SMALL_NATS_5((n) + 32)
+#define SMALL_NATS_7(n) SMALL_NATS_6(n) SMALL_NATS_6((n) + 64)
+#define SMALL_NATS_8(n) SMALL_NATS_7(n) SMALL_NATS_7((n) + 128)
+#define SMALL_NATS_9(n) SMALL_NATS_8(n) SMALL_NATS_8((n) + 256)
+#define SMALL_NATS_10(n) SMALL_NATS_9(n) SMALL_NATS_9((n) + 512)
+#define SMALL_NATS_11(n) SMALL_NATS_10(n) SMALL_NATS_10((n) + 1024)
 
-stella_object *nat_to_stella_object(int n) {
-  stella_object *result, *x;
+static const struct small_nat small_nats[STELLA_SMALL_NAT_MAX + 1] = {
+  { 0 },
+#if STELLA_SMALL_NAT_MAX & (1 << 11)
+  SMALL_NATS_11((STELLA_SMALL_NAT_MAX & ~((2 << 11) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 10)
+  SMALL_NATS_10((STELLA_SMALL_NAT_MAX & ~((2 << 10) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 9)
+  SMALL_NATS_9((STELLA_SMALL_NAT_MAX & ~((2 << 9) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 8)
+  SMALL_NATS_8((STELLA_SMALL_NAT_MAX & ~((2 << 8) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 7)
+  SMALL_NATS_7((STELLA_SMALL_NAT_MAX & ~((2 << 7) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 6)
+  SMALL_NATS_6((STELLA_SMALL_NAT_MAX & ~((2 << 6) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 5)
+  SMALL_NATS_5((STELLA_SMALL_NAT_MAX & ~((2 << 5) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 4)
+  SMALL_NATS_4((STELLA_SMALL_NAT_MAX & ~((2 << 4) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 3)
+  SMALL_NATS_3((STELLA_SMALL_NAT_MAX & ~((2 << 3) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 2)
+  SMALL_NATS_2((STELLA_SMALL_NAT_MAX & ~((2 << 2) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 1)
+  SMALL_NATS_1((STELLA_SMALL_NAT_MAX & ~((2 << 1) - 1)) + 1)
+#endif
+#if STELLA_SMALL_NAT_MAX & (1 << 0)
+  SMALL_NATS_0((STELLA_SMALL_NAT_MAX & ~((2 << 0) - 1)) + 1)
+#endif
+};
+
+static stella_object *small_nat(const int n) {
+  // negative numbers come from subtraction in generated code and are truncated to zero
+  return n <= 0 ? &the_ZERO : (stella_object*)&small_nats[n];
+}
+#endif
+
+#ifndef STELLA_BINARY_NAT
+/** Put n succ objects in front of an existing Nat (which is shared, not copied). */
+static stella_object *succ_chain(size_t n, stella_object *tail) {
+  const size_t size = sizeof(stella_object) + sizeof(stella_ref);
+  const size_t stride = size + GC_OBJECT_HEADER_SIZE;
+  stella_object *result;
   gc_push_root((void*)&result);    // it is sufficient to push only result
-  result = &the_ZERO;
-  for (int i = n; i > 0; i--) {
-    x = alloc_stella_object(TAG_SUCC, 1);
-    STELLA_OBJECT_INIT_FIELD(x, 0, result);
-    result = x;
+  result = tail;
+  while (n > 0) {
+    // the chain is allocated in blocks as large as the nursery allows, each with a single check;
+    // inside a block every succ points to the next object in memory, and the last one to the rest of the chain
+    size_t count = n;
+    char *block = gc_alloc_n(&count, size);
+    for (size_t i = 0; i < count; i++) {
+      stella_object *x = (stella_object*)(block + i * stride);
+      stella_object *pred = i + 1 < count ? (stella_object*)(block + (i + 1) * stride) : result;
+      x->object_header = STELLA_OBJECT_HEADER(TAG_SUCC, 1);
+      STELLA_OBJECT_INIT_FIELD(x, 0, pred);
+    }
+#ifdef STELLA_RUNTIME_STATS
+    total_allocated_fields += count;
+    tag_stats[TAG_SUCC].allocated_objects += count;
+    tag_stats[TAG_SUCC].allocated_fields += count;
+    tag_stats[TAG_SUCC].allocated_bytes += count * size;
+#endif
+    result = (stella_object*)block;
+    n -= count;
   }
   gc_pop_root((void*)&result);
   return result;
 }
+#endif
+
+stella_object *nat_to_stella_object(int n) {
+  if (n <= STELLA_SMALL_NAT_MAX) {
+    return small_nat(n);
+  }
+#ifdef STELLA_BINARY_NAT
+  return alloc_boxed_nat(n);
+#else
+  // only the part above the table is allocated
+  return succ_chain(n - STELLA_SMALL_NAT_MAX, small_nat(STELLA_SMALL_NAT_MAX));
+#endif
+}
 
-int stella_object_to_nat(stella_object* obj) {
-  int result = 0;
+stella_object *alloc_boxed_nat(size_t n) {
+  if (n <= STELLA_SMALL_NAT_MAX) {
+    return small_nat(n);
+  }
+  if (n > STELLA_BOXED_NAT_MAX) {
+    exit_with_nat_overflow_error();
+  }
+  stella_object *obj = alloc_stella_object(TAG_SUCC, 1);
+  obj->object_header |= STELLA_NAT_BOXED;
+  obj->object_fields[0] = STELLA_REF_ENCODE(n);
+  return obj;
+}
+
+stella_object *boxed_nat_pred(stella_object *obj) {
+  return alloc_boxed_nat(STELLA_BOXED_NAT_VALUE(obj) - 1);
+}
+
+size_t stella_object_to_nat(stella_object* obj) {
+  size_t result = 0;
+  // a chain of succ objects may end with a boxed Nat (e.g. succ(n) for a boxed n)
   while (STELLA_OBJECT_HEADER_TAG(obj->object_header) == TAG_SUCC) {
-    obj = STELLA_OBJECT_SUCC_ARG(obj);
+    if (STELLA_OBJECT_IS_BOXED_NAT(obj)) {
+      if (__builtin_add_overflow(result, STELLA_BOXED_NAT_VALUE(obj), &result)) {
+        exit_with_nat_overflow_error();
+      }
+      return result;
+    }
+    obj = STELLA_OBJECT_READ_FIELD(obj, 0);
     result += 1;
   }
   return result;
 }
 
+void exit_with_nat_overflow_error() {
+  printf("Nat overflow!");
+  exit(1);
+}
+
+stella_object *stella_nat_add(stella_object *a, stella_object *b) {
+#ifdef STELLA_BINARY_NAT
+  size_t sum;
+  if (__builtin_add_overflow(stella_object_to_nat(a), stella_object_to_nat(b), &sum)) {
+    exit_with_nat_overflow_error();
+  }
+  return alloc_boxed_nat(sum);
+#else
+  // share the longer chain and allocate only the shorter one in front of it;
+  // both chains are walked in lockstep, so only the length of the shorter one is counted
+  stella_object *p = a, *q = b;
+  size_t steps = 0;
+  while (STELLA_OBJECT_HEADER_TAG(p->object_header) == TAG_SUCC && !STELLA_OBJECT_IS_BOXED_NAT(p)
+         && STELLA_OBJECT_HEADER_TAG(q->object_header) == TAG_SUCC && !STELLA_OBJECT_IS_BOXED_NAT(q)) {
+    p = STELLA_OBJECT_READ_FIELD(p, 0);
+    q = STELLA_OBJECT_READ_FIELD(q, 0);
+    steps += 1;
+  }
+  if (STELLA_OBJECT_HEADER_TAG(p->object_header) != TAG_SUCC) {
+    return succ_chain(steps, b);
+  }
+  if (STELLA_OBJECT_HEADER_TAG(q->object_header) != TAG_SUCC) {
+    return succ_chain(steps, a);
+  }
+  // a chain ending with a boxed Nat is not necessarily the shorter one, so both are counted
+  const size_t x = stella_object_to_nat(a);
+  const size_t y = stella_object_to_nat(b);
+  return x < y ? succ_chain(x, b) : succ_chain(y, a);
+#endif
+}
+
+stella_object *stella_nat_sub(stella_object *a, stella_object *b) {
+  size_t y = stella_object_to_nat(b);
+  // drop y succ objects from a: the result is a suffix of the chain of a
+  while (y > 0 && STELLA_OBJECT_HEADER_TAG(a->object_header) == TAG_SUCC) {
+    if (STELLA_OBJECT_IS_BOXED_NAT(a)) {
+      const size_t x = STELLA_BOXED_NAT_VALUE(a);
+      return alloc_boxed_nat(x > y ? x - y : 0);
+    }
+    a = STELLA_OBJECT_READ_FIELD(a, 0);
+    y -= 1;
+  }
+  return a;
+}
+
+stella_object *stella_nat_mul(stella_object *a, stella_object *b) {
+  const size_t x = stella_object_to_nat(a);
+  const size_t y = stella_object_to_nat(b);
+  if (x == 0 || y == 0) {
+    return &the_ZERO;
+  }
+  size_t product;
+  if (__builtin_mul_overflow(x, y, &product)) {
+    exit_with_nat_overflow_error();
+  }
+#ifdef STELLA_BINARY_NAT
+  return alloc_boxed_nat(product);
+#else
+  // share the longer chain as the tail of the product
+  return x < y ? succ_chain(product - y, b) : succ_chain(product - x, a);
+#endif
+}
+
+stella_object *stella_nat_eq(stella_object *a, stella_object *b) {
+  if (a == b) {
+    return &the_TRUE;
+  }
+  return stella_object_to_nat(a) == stella_object_to_nat(b) ? &the_TRUE : &the_FALSE;
+}
+
 stella_object* stella_object_nat_rec(stella_object* n, stella_object* z, stella_object* f) {
   stella_object *g;
 #ifdef STELLA_DEBUG
@@ -66,18 +274,44 @@ stella_object* stella_object_nat_rec(stella_object* n, stella_object* z, stella_
   printf("f = "); print_stella_object(f);
   printf(")\n");
 #endif
-  gc_push_root((void**)&n);
-  gc_push_root((void**)&z);
-  gc_push_root((void**)&f);
-  while (STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_SUCC) {
-    n = STELLA_OBJECT_SUCC_ARG(n);
-    g = STELLA_OBJECT_CLOSURE_CALL(f, n);
-    z = STELLA_OBJECT_CLOSURE_CALL(g, z);
+  // all three roots are registered as a single frame
+  struct { stella_object *n, *z, *f; } roots = { n, z, f };
+  gc_push_frame((void**)&roots, 3);
+  while (STELLA_OBJECT_HEADER_TAG(roots.n->object_header) == TAG_SUCC) {
+    roots.n = STELLA_OBJECT_SUCC_ARG(roots.n);
+#ifdef STELLA_RUNTIME_STATS
+    const uint64_t closures = tag_stats[TAG_FN].allocated_objects;
+#endif
+    g = STELLA_OBJECT_CLOSURE_CALL(roots.f, roots.n);
+#ifdef STELLA_RUNTIME_STATS
+    nat_rec_iterations++;
+    nat_rec_step_closures += tag_stats[TAG_FN].allocated_objects - closures;
+#endif
+    roots.z = STELLA_OBJECT_CLOSURE_CALL(g, roots.z);
+  }
+  gc_pop_frame();
+  return roots.z;
+}
+
+stella_object* stella_object_nat_rec2(stella_object* n, stella_object* z, stella_object* f) {
+#ifdef STELLA_DEBUG
+  printf("[debug] call Nat::rec2(");
+  printf("n = "); print_stella_object(n); printf(", ");
+  printf("z = "); print_stella_object(z); printf(", ");
+  printf("f = "); print_stella_object(f);
+  printf(")\n");
+#endif
+  struct { stella_object *n, *z, *f; } roots = { n, z, f };
+  gc_push_frame((void**)&roots, 3);
+  while (STELLA_OBJECT_HEADER_TAG(roots.n->object_header) == TAG_SUCC) {
+    roots.n = STELLA_OBJECT_SUCC_ARG(roots.n);
+#ifdef STELLA_RUNTIME_STATS
+    nat_rec_iterations++;
+#endif
+    roots.z = STELLA_OBJECT_CLOSURE_CALL2(roots.f, roots.n, roots.z);
   }
-  gc_pop_root((void**)&f);
-  gc_pop_root((void**)&z);
-  gc_pop_root((void**)&n);
-  return z;
+  gc_pop_frame();
+  return roots.z;
 }
 
 void print_stella_object(stella_object* obj) {
@@ -88,7 +322,7 @@ void print_stella_object(stella_object* obj) {
       printf("0");
       return;
     case TAG_SUCC:
-      printf("%d", stella_object_to_nat(obj));
+      printf("%zu", stella_object_to_nat(obj));
       return;
     case TAG_FALSE:
       printf("false");
@@ -132,7 +366,7 @@ void print_stella_object(stella_object* obj) {
     case TAG_TUPLE:
       printf("{");
       for (int i = 0; i < fields_count; i++) {
-        print_stella_object(obj->object_fields[i]);
+        print_stella_object(STELLA_OBJECT_READ_FIELD(obj, i));
         if (i < fields_count - 1) { printf(", "); }
       }
       printf("}");  // TODO: pretty print a tuple
@@ -140,6 +374,42 @@ void print_stella_object(stella_object* obj) {
   }
 }
 
+#ifdef STELLA_RUNTIME_STATS
+static const char *tag_name(const int tag) {
+  switch (tag) {
+    case TAG_ZERO: return "ZERO";
+    case TAG_SUCC: return "SUCC";
+    case TAG_FALSE: return "FALSE";
+    case TAG_TRUE: return "TRUE";
+    case TAG_FN: return "FN";
+    case TAG_REF: return "REF";
+    case TAG_UNIT: return "UNIT";
+    case TAG_TUPLE: return "TUPLE";
+    case TAG_INL: return "INL";
+    case TAG_INR: return "INR";
+    case TAG_EMPTY: return "EMPTY";
+    case TAG_CONS: return "CONS";
+    default: return "?";
+  }
+}
+
+static void print_tag_stats() {
+  printf("Allocations by tag:\n");
+  printf("  %-6s %12s %14s %10s %12s %12s\n", "TAG", "objects", "bytes", "avg fields", "survived", "promoted");
+  for (int tag = 0; tag < STELLA_TAG_COUNT; tag++) {
+    const stella_tag_stats *stats = &tag_stats[tag];
+    if (stats->allocated_objects == 0) continue;
+    printf("  %-6s %12" PRIu64 " %14" PRIu64 " %10.2f %12" PRIu64 " %12" PRIu64 "\n",
+           tag_name(tag),
+           stats->allocated_objects,
+           stats->allocated_bytes,
+           (double)stats->allocated_fields / stats->allocated_objects,
+           stats->survived_objects,
+           stats->promoted_objects);
+  }
+}
+#endif
+
 void print_stella_stats() {
   #ifdef STELLA_GC_STATS
   printf("\n------------------------------------------------------------\n");
@@ -149,6 +419,10 @@ void print_stella_stats() {
   #ifdef STELLA_RUNTIME_STATS
   printf("\n------------------------------------------------------------\n");
   printf("Stella runtime statistics:\n");
-  printf("Total allocated fields in Stella objects: %'d fields\n", total_allocated_fields);
+  printf("Total allocated fields in Stella objects: %'" PRIu64 " fields\n", total_allocated_fields);
+  print_tag_stats();
+  printf("Nat::rec iterations: %" PRIu64 ", step closures allocated: %" PRIu64 " (%.2f per iteration, avoidable with stella_object_nat_rec2)\n",
+         nat_rec_iterations, nat_rec_step_closures,
+         nat_rec_iterations == 0 ? 0.0 : (double)nat_rec_step_closures / nat_rec_iterations);
   #endif
 }
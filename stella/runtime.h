@@ -4,39 +4,88 @@
 #include <stdio.h>
 #include "gc.h"
 
+#ifdef STELLA_COMPRESSED_REFS
+/** A field of a heap object: a 32-bit reference.
+ * Requires every address stored in a field to be below 4 GiB: the GC maps the heap there,
+ * and the program must be linked without PIE (-no-pie) for code and static objects (checked in gc_init).
+ */
+typedef uint32_t stella_ref;
+#define STELLA_REF_ENCODE(ptr) ((stella_ref)(uintptr_t)(ptr))
+#define STELLA_REF_DECODE(ref) ((void*)(uintptr_t)(ref))
+#else
+/** A field of a heap object: a plain pointer. */
+typedef void* stella_ref;
+#define STELLA_REF_ENCODE(ptr) ((void*)(ptr))
+#define STELLA_REF_DECODE(ref) (ref)
+#endif
+
 /** A Stella object with statically unknown number of fields.
  */
 typedef struct {
   int    object_header;     /**< Header of the object contains
                               * its TAG (see STELLA_OBJECT_HEADER_TAG) and
                               * the number of fields (see STELLA_OBJECT_HEADER_FIELD_COUNT). */
-  void*  object_fields[0];  /**< An array of object fields (0 fields for static objects). */
+  stella_ref object_fields[0];  /**< An array of object fields (0 fields for static objects). */
 } stella_object;
 
+#ifdef STELLA_COMPRESSED_REFS
+/** Get a field of a Stella object without a barrier.
+ * Static objects (see stella_object_1) keep full pointers and declare 0 fields in the header.
+ */
+#define STELLA_OBJECT_GET_FIELD(obj, i) (STELLA_OBJECT_HEADER_FIELD_COUNT((obj)->object_header) == 0 \
+    ? ((stella_object_1*)(obj))->object_fields[i] : STELLA_REF_DECODE((obj)->object_fields[i]))
+#else
+/** Get a field of a Stella object without a barrier. */
+#define STELLA_OBJECT_GET_FIELD(obj, i) ((obj)->object_fields[i])
+#endif
+
 /** Read a field from a Stella object. Subject to a read barrier. */
-#define STELLA_OBJECT_READ_FIELD(obj, i) GC_READ_BARRIER(obj, i, ((stella_object*)(obj->object_fields[i])))
+#define STELLA_OBJECT_READ_FIELD(obj, i) GC_READ_BARRIER(obj, i, ((stella_object*)STELLA_OBJECT_GET_FIELD(obj, i)))
 /** (Over)write a field from a Stella object. Subject to a write barrier.
  * See STELLA_OBJECT_INIT_FIELD for initialization of fields (which does not trigger the write barrier).
  */
-#define STELLA_OBJECT_WRITE_FIELD(obj, i, x) GC_WRITE_BARRIER(obj, i, x, (obj->object_fields[i] = (void*)x))
+#define STELLA_OBJECT_WRITE_FIELD(obj, i, x) GC_WRITE_BARRIER(obj, i, STELLA_REF_DECODE(obj->object_fields[i]), (obj->object_fields[i] = STELLA_REF_ENCODE(x)))
 
 /** Extract the TAG from Stella object's header. */
 #define STELLA_OBJECT_HEADER_TAG(header) (header & TAG_MASK)
+/** Build a Stella object's header from a TAG and a fields count (a constant for constant arguments). */
+#define STELLA_OBJECT_HEADER(tag, count) ((count) << 4 | (tag))
 /** Extract the fields count from Stella object's header. */
 #define STELLA_OBJECT_HEADER_FIELD_COUNT(header) ((header & FIELD_COUNT_MASK) >> 4)
 
-/** Extract the n from succ(n). */
-#define STELLA_OBJECT_SUCC_ARG(obj) STELLA_OBJECT_READ_FIELD(obj,0)
+/** Header bits above STELLA_NAT_BOXED are reserved for the GC (see gc.c). */
+
+/** Header flag of a boxed Nat: a TAG_SUCC object whose only field holds its value as a machine integer
+ * instead of a pointer to the predecessor (see alloc_boxed_nat).
+ */
+#define STELLA_NAT_BOXED (1 << 8)
+/** Check whether a Stella object is a boxed Nat. */
+#define STELLA_OBJECT_IS_BOXED_NAT(obj) ((obj)->object_header & STELLA_NAT_BOXED)
+/** Extract the value of a boxed Nat. */
+#define STELLA_BOXED_NAT_VALUE(obj) ((size_t)STELLA_REF_DECODE((obj)->object_fields[0]))
+/** The largest value a boxed Nat can hold: the width of a field (32 bits with STELLA_COMPRESSED_REFS). */
+#ifdef STELLA_COMPRESSED_REFS
+#define STELLA_BOXED_NAT_MAX ((size_t)UINT32_MAX)
+#else
+#define STELLA_BOXED_NAT_MAX SIZE_MAX
+#endif
+/** Extract the number of fields holding references to other objects (the only ones traced by the GC). */
+#define STELLA_OBJECT_HEADER_POINTER_COUNT(header) (((header) & STELLA_NAT_BOXED) ? 0 : STELLA_OBJECT_HEADER_FIELD_COUNT((header)))
+
+/** Extract the n from succ(n). The predecessor of a boxed Nat is produced on demand. */
+#define STELLA_OBJECT_SUCC_ARG(obj) (STELLA_OBJECT_IS_BOXED_NAT(obj) ? boxed_nat_pred(obj) : STELLA_OBJECT_READ_FIELD(obj,0))
 
 /** Initialize new Stella object's TAG. */
 #define STELLA_OBJECT_INIT_TAG(obj, tag) (obj->object_header = ((obj->object_header >> 4) << 4) | tag)
 /** Initialize new Stella object's fields count. */
 #define STELLA_OBJECT_INIT_FIELDS_COUNT(obj, count) (obj->object_header = ((obj->object_header >> 8) << 8) | STELLA_OBJECT_HEADER_TAG(obj->object_header) | count << 4)
-/** Initialize new Stella object's field. */
-#define STELLA_OBJECT_INIT_FIELD(obj, i, x) (obj->object_fields[i] = (void*)x)
+/** Initialize new Stella object's field. Subject to an initialization barrier (see GC_INIT_BARRIER). */
+#define STELLA_OBJECT_INIT_FIELD(obj, i, x) GC_INIT_BARRIER(obj, i, STELLA_REF_DECODE(obj->object_fields[i]), (obj->object_fields[i] = STELLA_REF_ENCODE(x)))
 
 /** Call a Stella function (closure) with a given Stella object as an argument. */
 #define STELLA_OBJECT_CLOSURE_CALL(f, x) (*(stella_object *(*)(stella_object *, stella_object *))STELLA_OBJECT_READ_FIELD(f, 0))(f, x)
+/** Call a two-argument Stella function (closure) with given Stella objects as arguments. */
+#define STELLA_OBJECT_CLOSURE_CALL2(f, x, y) (*(stella_object *(*)(stella_object *, stella_object *, stella_object *))STELLA_OBJECT_READ_FIELD(f, 0))(f, x, y)
 
 /** A Stella object dedicated for static objects with one field,
  * which is how closures for top-level definitions are represented by default.
@@ -64,22 +113,55 @@ enum TAG {
   TAG_CONS    /**< cons(..., ...) */
   } ;
 
-/** Allocate a new Stella object with a given TAG and number of fields.
- * Note that this function makes use of gc_alloc.
- */
-stella_object* alloc_stella_object(enum TAG tag, int fields_count);
+/** Naturals 0..STELLA_SMALL_NAT_MAX are static objects, so converting them does not allocate. */
+#ifndef STELLA_SMALL_NAT_MAX
+#define STELLA_SMALL_NAT_MAX 256
+#endif
 
-/** Convert a natural number (non-negative integer) into a corresponding Stella object. */
+/** Convert a natural number (non-negative integer) into a corresponding Stella object.
+ * Builds a chain of succ objects, or a single boxed Nat if compiled with STELLA_BINARY_NAT.
+ */
 stella_object *nat_to_stella_object(int n);
-/** Convert a natural number represented as a Stella object to an integer. */
-int stella_object_to_nat(stella_object* obj);
+/** Allocate a boxed Nat holding n as a machine integer (a static object for n <= STELLA_SMALL_NAT_MAX).
+ * Stops the program with "Nat overflow!" if n is above STELLA_BOXED_NAT_MAX.
+ */
+stella_object *alloc_boxed_nat(size_t n);
+/** The predecessor of a boxed Nat (a newly allocated boxed Nat or the_ZERO). */
+stella_object *boxed_nat_pred(stella_object *obj);
+/** Convert a natural number represented as a Stella object to an integer.
+ * Stops the program with "Nat overflow!" if the value does not fit into size_t.
+ */
+size_t stella_object_to_nat(stella_object* obj);
+/** Stop the program because a Nat does not fit into a machine integer. */
+void exit_with_nat_overflow_error();
 /** Pretty-print a Stella object. */
 void print_stella_object(stella_object* obj);
 /** Print some Stella runtime statistics. */
 void print_stella_stats();
 
+/** Nat addition. Shares the longer operand and allocates only as many succ objects as the shorter one has.
+ * Stops the program with "Nat overflow!" if the sum does not fit into a boxed Nat (STELLA_BINARY_NAT).
+ */
+stella_object *stella_nat_add(stella_object *a, stella_object *b);
+/** Nat subtraction (truncated at zero). Returns a suffix of the chain of a without allocating. */
+stella_object *stella_nat_sub(stella_object *a, stella_object *b);
+/** Nat multiplication. Shares the longer operand as the tail of the product.
+ * Stops the program with "Nat overflow!" if the product does not fit into size_t (or into a boxed Nat).
+ */
+stella_object *stella_nat_mul(stella_object *a, stella_object *b);
+/** Nat equality. Returns the_TRUE or the_FALSE. */
+stella_object *stella_nat_eq(stella_object *a, stella_object *b);
+
 /** Builtin implementation for Stella's Nat::rec. */
 stella_object* stella_object_nat_rec(stella_object* n, stella_object* z, stella_object* f);
+/** Builtin implementation for Stella's Nat::rec with an uncurried step function.
+ * f is a closure whose function takes both arguments at once:
+ *
+ *   stella_object *step(stella_object *closure, stella_object *i, stella_object *acc);
+ *
+ * so Nat::rec(n, z, fn(i) { return fn(acc) { ... } }) needs no intermediate closure per iteration.
+ */
+stella_object* stella_object_nat_rec2(stella_object* n, stella_object* z, stella_object* f);
 
 /** The static Stella object for zero. */
 extern stella_object the_ZERO;
@@ -105,4 +187,56 @@ extern const int FIELD_COUNT_MASK;
 /** The bitmask for the Stella object tag. */
 extern const int TAG_MASK;
 
+/** Total number of fields in allocated Stella objects (see STELLA_RUNTIME_STATS). */
+extern uint64_t total_allocated_fields;
+/** Number of Nat::rec iterations and of closures allocated by curried step functions in them (see STELLA_RUNTIME_STATS). */
+extern uint64_t nat_rec_iterations;
+extern uint64_t nat_rec_step_closures;
+
+/** Number of distinct Stella object tags (see TAG_MASK). */
+#define STELLA_TAG_COUNT 16
+
+/** Allocation and survival counters of Stella objects with one TAG (see STELLA_RUNTIME_STATS). */
+typedef struct {
+  uint64_t allocated_objects; /**< Number of allocations, including static objects. */
+  uint64_t allocated_bytes;   /**< Number of bytes allocated on the heap. */
+  uint64_t allocated_fields;  /**< Total number of fields in allocated objects. */
+  uint64_t survived_objects;  /**< Number of objects that survived their first nursery collection. */
+  uint64_t promoted_objects;  /**< Number of objects promoted to generation 1. */
+} stella_tag_stats;
+
+/** Per-TAG allocation and survival counters, indexed by TAG (see STELLA_RUNTIME_STATS). */
+extern stella_tag_stats tag_stats[STELLA_TAG_COUNT];
+
+/** Allocate a new Stella object with a given TAG and number of fields.
+ * Note that this function makes use of gc_alloc.
+ * The generated code passes constant arguments, so the switch and the header are resolved at compile time.
+ */
+static inline stella_object* alloc_stella_object(const enum TAG tag, const int fields_count) {
+  stella_object *obj;
+#ifdef STELLA_RUNTIME_STATS
+  total_allocated_fields += fields_count;
+  tag_stats[tag].allocated_objects++;
+  tag_stats[tag].allocated_fields += fields_count;
+#endif
+  switch (tag) {
+    // do not allocate constant objects
+    case TAG_ZERO: return &the_ZERO;
+    case TAG_FALSE: return &the_FALSE;
+    case TAG_TRUE: return &the_TRUE;
+    case TAG_UNIT: return &the_UNIT;
+    case TAG_EMPTY: return &the_EMPTY;
+    case TAG_TUPLE: if (fields_count == 0) { return &the_EMPTY_TUPLE; }
+    // allocate an object with at least one field (or an unknown tag);
+    // the GC needs room for one field in every heap object, even without fields
+    default:
+      obj = gc_alloc(sizeof(stella_object) + (fields_count > 0 ? fields_count : 1) * sizeof(stella_ref));
+      obj->object_header = STELLA_OBJECT_HEADER(tag, fields_count);
+#ifdef STELLA_RUNTIME_STATS
+      tag_stats[tag].allocated_bytes += sizeof(stella_object) + (fields_count > 0 ? fields_count : 1) * sizeof(stella_ref);
+#endif
+      return obj;
+  }
+}
+
 #endif